@@ -39,6 +39,7 @@
 #include <iostream>
 #include <vector>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string>
@@ -3223,6 +3224,66 @@ pkgAcqArchive::pkgAcqArchive(pkgAcquire * const Owner,pkgSourceList * const Sour
 		    Version.VerStr(), Version.ParentPkg().FullName(false).c_str());
 }
 									/*}}}*/
+// SharedArchiveFile - Name of an archive in the shared store		/*{{{*/
+// ---------------------------------------------------------------------
+/* The store in Dir::Cache::SharedArchives holds archives named by their
+   SHA256 hash, so that chroots and containers on a host (which bind mount
+   the directory) don't need to download the same files over and over. */
+static std::string SharedArchiveFile(HashStringList const &Hashes)
+{
+   if (_config->Find("Dir::Cache::SharedArchives").empty() == true)
+      return "";
+   HashString const * const Hash = Hashes.find("SHA256");
+   if (Hash == nullptr || Hash->empty() == true)
+      return "";
+   return _config->FindDir("Dir::Cache::SharedArchives") + Hash->HashValue();
+}
+									/*}}}*/
+// SharedArchiveStoreIsSafe - Check if files may be linked with the store	/*{{{*/
+// ---------------------------------------------------------------------
+/* A hard link shares the file with the store, so everyone able to write
+   to it could change an archive after apt verified it. Files are only
+   linked if the store (and the file in it) are owned by root and nobody
+   else can write to them. */
+static bool SharedArchiveStoreIsSafe(std::string const &File)
+{
+   struct stat Buf;
+   if (stat(flNotFile(File).c_str(), &Buf) != 0 || Buf.st_uid != 0 ||
+	 (Buf.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+      return false;
+   if (stat(File.c_str(), &Buf) != 0)
+      return errno == ENOENT;
+   return Buf.st_uid == 0 && (Buf.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+									/*}}}*/
+// LinkOrCopyArchive - Make To a (preferably hard linked) copy of From	/*{{{*/
+// ---------------------------------------------------------------------
+/* If linking isn't allowed or possible the file is copied instead (which
+   CopyFile does with a reflink if possible) to a temporary file which is
+   moved into place, so that nobody will ever see a partial file. An
+   existing To is replaced as we don't know what it contains. */
+static bool LinkOrCopyArchive(std::string const &From, std::string const &To, bool const MayLink)
+{
+   if (MayLink == true && link(From.c_str(), To.c_str()) == 0)
+      return true;
+
+   std::string Tmp = To + ".XXXXXX";
+   int const TmpFd = mkstemp(&Tmp[0]);
+   if (TmpFd == -1)
+      return _error->Errno("mkstemp", _("Unable to write to %s"), flNotFile(To).c_str());
+   FileFd In(From, FileFd::ReadOnly);
+   FileFd Out(TmpFd, true);
+   if (fchmod(TmpFd, 0644) != 0)
+      _error->Errno("fchmod", "Failed to set permission of file %s", Tmp.c_str());
+   else if (In.IsOpen() == true && CopyFile(In, Out) == true && Out.Close() == true &&
+	 rename(Tmp.c_str(), To.c_str()) == 0)
+      return true;
+   else if (_error->PendingError() == false)
+      _error->Error(_("rename failed, %s (%s -> %s)."), strerror(errno), Tmp.c_str(), To.c_str());
+   RemoveFile("LinkOrCopyArchive", Tmp);
+   return false;
+}
+									/*}}}*/
 // AcqArchive::QueueNext - Queue the next file source			/*{{{*/
 // ---------------------------------------------------------------------
 /* This queues the next available file version for download. It checks if
@@ -3306,6 +3367,31 @@ bool pkgAcqArchive::QueueNext()
 	 RemoveFile("pkgAcqArchive::QueueNext", FinalFile);
       }
 
+      // Check if another system sharing the store got the file already
+      std::string const SharedFile = SharedArchiveFile(ExpectedHashes);
+      if (SharedFile.empty() == false && stat(SharedFile.c_str(),&Buf) == 0 &&
+	  (unsigned long long)Buf.st_size == Version->Size)
+      {
+	 // verify what we got, not the file in the store which can change
+	 _error->PushToStack();
+	 bool const Linked = LinkOrCopyArchive(SharedFile, FinalFile, SharedArchiveStoreIsSafe(SharedFile)) &&
+	    ExpectedHashes.VerifyFile(FinalFile);
+	 _error->RevertToStack();
+	 if (Linked == false)
+	    RemoveFile("pkgAcqArchive::QueueNext", FinalFile);
+	 else
+	 {
+	    // the access time tells apt-get clean which files were used last
+	    struct timespec const Times[2] = { { 0, UTIME_NOW }, { 0, UTIME_OMIT } };
+	    utimensat(AT_FDCWD, SharedFile.c_str(), Times, 0);
+	    Complete = true;
+	    Local = true;
+	    Status = StatDone;
+	    StoreFilename = DestFile = FinalFile;
+	    return true;
+	 }
+      }
+
       DestFile = _config->FindDir("Dir::Cache::Archives") + "partial/" + flNotDir(StoreFilename);
       
       // Check the destination file
@@ -3361,6 +3447,19 @@ void pkgAcqArchive::Done(string const &Message, HashStringList const &Hashes,
    Rename(DestFile,FinalFile);
    StoreFilename = DestFile = FinalFile;
    Complete = true;
+
+   // Offer it to others sharing the store
+   std::string const SharedFile = SharedArchiveFile(ExpectedHashes);
+   if (SharedFile.empty() == false && RealFileExists(SharedFile) == false)
+   {
+      std::string const SharedDir = flNotFile(SharedFile);
+      _error->PushToStack();
+      bool const Shared = (mkdir(SharedDir.c_str(), 0755) == 0 || errno == EEXIST) &&
+	 LinkOrCopyArchive(FinalFile, SharedFile, SharedArchiveStoreIsSafe(SharedFile)) == true;
+      _error->RevertToStack();
+      if (Shared == false)
+	 _error->Warning(_("Can't add %s to the shared archives in %s"), flNotDir(FinalFile).c_str(), SharedDir.c_str());
+   }
 }
 									/*}}}*/
 // AcqArchive::Failed - Failure handler					/*{{{*/
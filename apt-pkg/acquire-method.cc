@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -39,6 +40,10 @@
 
 using namespace std;
 
+// what is left of the 604 Bandwidth Grants, kept outside of the class as
+// it has no room for private data and there is one method per process
+static unsigned long long BandwidthBudget = 0;
+
 // AcqMethod::pkgAcqMethod - Constructor				/*{{{*/
 // ---------------------------------------------------------------------
 /* This constructs the initialization text */
@@ -65,6 +70,9 @@ pkgAcqMethod::pkgAcqMethod(const char *Ver,unsigned long Flags)
    if ((Flags & Removable) == Removable)
       std::cout << "Removable: true\n";
 
+   if ((Flags & BandwidthGrants) == BandwidthGrants)
+      std::cout << "Bandwidth-Grants: true\n";
+
    std::cout << "\n" << std::flush;
 
    SetNonBlock(STDIN_FILENO,true);
@@ -367,6 +375,15 @@ int pkgAcqMethod::Run(bool Single)
 	    return 100;
 	 break;
 	 
+	 case 604:
+	 {
+	    // keep only as much of the unused budget as is granted again, so
+	    // that a method which was stalled can't overshoot the limit later
+	    unsigned long long const Bytes = strtoull(LookupTag(Message, "Bytes", "0").c_str(), NULL, 10);
+	    BandwidthBudget = std::min(BandwidthBudget, Bytes) + Bytes;
+	    break;
+	 }
+
 	 case 600:
 	 {
 	    FetchItem *Tmp = new FetchItem;
@@ -416,6 +433,11 @@ int pkgAcqMethod::Run(bool Single)
 // AcqMethod::PrintStatus - privately really send a log/status message	/*{{{*/
 void pkgAcqMethod::PrintStatus(char const * const header, const char* Format,
 			       va_list &args) const
+{
+   PrintStatus(header, "", Format, args);
+}
+void pkgAcqMethod::PrintStatus(char const * const header, std::string const &Fields,
+			       const char* Format, va_list &args) const
 {
    string CurrentURI = "<UNKNOWN>";
    if (Queue != 0)
@@ -427,7 +449,7 @@ void pkgAcqMethod::PrintStatus(char const * const header, const char* Format,
       fprintf(stdout, "%s\nURI: %s\nUsedMirror: %s\nMessage: ",
 	      header, CurrentURI.c_str(), UsedMirror.c_str());
    vfprintf(stdout,Format,args);
-   std::cout << "\n\n" << std::flush;
+   std::cout << Fields << "\n\n" << std::flush;
 }
 									/*}}}*/
 // AcqMethod::Log - Send a log message					/*{{{*/
@@ -452,6 +474,23 @@ void pkgAcqMethod::Status(const char *Format,...)
    va_end(args);
 }
 									/*}}}*/
+// AcqMethod::ResolverResult - Send a status message with a lookup	/*{{{*/
+// ---------------------------------------------------------------------
+/* Keys or values with spaces or newlines can't be passed on, the message
+   is sent without them then. */
+void pkgAcqMethod::ResolverResult(std::string const &Key, std::string const &Value,
+      const char *Format,...)
+{
+   std::string Fields;
+   if (Key.empty() == false && Key.find_first_of(" \n") == std::string::npos &&
+	 Value.find_first_of(" \n") == std::string::npos)
+      Fields = "\nResolver-Cache: " + Key + '=' + Value;
+   va_list args;
+   va_start(args,Format);
+   PrintStatus("102 Status", Fields, Format, args);
+   va_end(args);
+}
+									/*}}}*/
 // AcqMethod::Redirect - Send a redirect message                       /*{{{*/
 // ---------------------------------------------------------------------
 /* This method sends the redirect message and dequeues the item as
@@ -491,6 +530,18 @@ void pkgAcqMethod::Dequeue() {						/*{{{*/
 									/*}}}*/
 pkgAcqMethod::~pkgAcqMethod() {}
 
+// AcqMethod::GrantedBandwidth - bytes the method may still read	/*{{{*/
+unsigned long long pkgAcqMethod::GrantedBandwidth()
+{
+   return BandwidthBudget;
+}
+									/*}}}*/
+// AcqMethod::UseBandwidth - account for bytes read			/*{{{*/
+void pkgAcqMethod::UseBandwidth(unsigned long long const Bytes)
+{
+   BandwidthBudget -= std::min(BandwidthBudget, Bytes);
+}
+									/*}}}*/
 pkgAcqMethod::FetchItem::FetchItem() :
    Next(nullptr), DestFileFd(-1), LastModified(0), IndexFile(false),
    FailIgnore(false), MaximumSize(0), d(nullptr)
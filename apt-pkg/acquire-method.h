@@ -100,15 +100,27 @@ class pkgAcqMethod
    virtual void Exit() {};
 
    void PrintStatus(char const * const header, const char* Format, va_list &args) const;
+   APT_HIDDEN void PrintStatus(char const * const header, std::string const &Fields,
+	 const char* Format, va_list &args) const;
 
    public:
    enum CnfFlags {SingleInstance = (1<<0),
                   Pipeline = (1<<1), SendConfig = (1<<2),
                   LocalOnly = (1<<3), NeedsCleanup = (1<<4), 
-                  Removable = (1<<5)};
+                  Removable = (1<<5), BandwidthGrants = (1<<6)};
 
    void Log(const char *Format,...);
    void Status(const char *Format,...);
+   /** \brief send a status message reporting the result of a lookup
+    *
+    *  The acquire system passes it on to the methods started later, so
+    *  that they don't need to repeat it (see Acquire::Resolver-Cache-Time).
+    *  It is only taken for the host of the current item.
+    *
+    *  \param Key identifying the lookup like "addr:" followed by the host
+    *  \param Value of the lookup, without spaces
+    */
+   void ResolverResult(std::string const &Key, std::string const &Value, const char *Format,...);
    
    void Redirect(const std::string &NewURI);
  
@@ -119,6 +131,15 @@ class pkgAcqMethod
    pkgAcqMethod(const char *Ver,unsigned long Flags = 0);
    virtual ~pkgAcqMethod();
    void DropPrivsOrDie();
+
+   /** \brief bytes the method may still read as granted by 604 messages
+    *
+    *  Only methods with the BandwidthGrants flag get these messages.
+    */
+   static unsigned long long GrantedBandwidth();
+   /** \brief account for bytes read from the granted bandwidth */
+   static void UseBandwidth(unsigned long long const Bytes);
+
    private:
    APT_HIDDEN void Dequeue();
 };
@@ -24,6 +24,7 @@
 #include <apt-pkg/hashes.h>
 
 #include <algorithm>
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -33,6 +34,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <sstream>
 
@@ -41,6 +43,17 @@
 
 using namespace std;
 
+// Lookups reported by the methods, passed on to the others with their items
+struct ResolverCacheEntry
+{
+   std::string Value;
+   time_t Time;
+   unsigned long Serial;
+};
+static std::map<std::string, ResolverCacheEntry> ResolverCache;
+static unsigned long ResolverCacheSerial = 0;
+static std::map<pkgAcquire::Worker const *, unsigned long> ResolverCacheSent;
+
 // Worker::Worker - Constructor for Queue startup			/*{{{*/
 pkgAcquire::Worker::Worker(Queue *Q, MethodConfig *Cnf, pkgAcquireStatus *log) :
    d(NULL), OwnerQ(Q), Log(log), Config(Cnf), Access(Cnf->Access),
@@ -74,6 +87,7 @@ void pkgAcquire::Worker::Construct()
 /* */
 pkgAcquire::Worker::~Worker()
 {
+   ResolverCacheSent.erase(this);
    close(InFd);
    close(OutFd);
    
@@ -203,6 +217,60 @@ enum class APT_HIDDEN MessageType {
    GENERAL_FAILURE = 401,
    MEDIA_CHANGE = 403
 };
+// MessageFields - index of the fields of a method message		/*{{{*/
+/* The message is split into its fields once, so that the many lookups
+   done while handling it (especially for the hashes in 201 URI Done)
+   do not need to rescan the entire message via LookupTag each time.
+   Offsets are stored rather than pointers as the message can be
+   appended to while it is handled. */
+class APT_HIDDEN MessageFields
+{
+   struct Field
+   {
+      size_t TagStart, TagEnd, ValueStart, ValueEnd;
+   };
+   std::string const &Message;
+   std::vector<Field> Fields;
+
+   public:
+   explicit MessageFields(std::string const &Msg) : Message(Msg)
+   {
+      size_t LineStart = 0;
+      while (LineStart < Message.length())
+      {
+	 size_t LineEnd = Message.find('\n', LineStart);
+	 if (LineEnd == std::string::npos)
+	    LineEnd = Message.length();
+	 size_t const Colon = Message.find(':', LineStart);
+	 if (Colon < LineEnd)
+	 {
+	    Field F;
+	    F.TagStart = LineStart;
+	    F.TagEnd = Colon;
+	    F.ValueStart = Colon + 1;
+	    F.ValueEnd = LineEnd;
+	    for (; F.ValueStart < F.ValueEnd && isspace_ascii(Message[F.ValueStart]) != 0; ++F.ValueStart);
+	    for (; F.ValueEnd > F.ValueStart && isspace_ascii(Message[F.ValueEnd - 1]) != 0; --F.ValueEnd);
+	    Fields.push_back(F);
+	 }
+	 LineStart = LineEnd + 1;
+      }
+   }
+
+   /** \brief same as LookupTag on the indexed message */
+   std::string Find(char const * const Tag, char const * const Default = nullptr) const
+   {
+      char const * const Data = Message.data();
+      char const * const TagEnd = Tag + strlen(Tag);
+      for (auto const &F : Fields)
+	 if (stringcasecmp(Data + F.TagStart, Data + F.TagEnd, Tag, TagEnd) == 0)
+	    return Message.substr(F.ValueStart, F.ValueEnd - F.ValueStart);
+      if (Default == nullptr)
+	 return std::string();
+      return Default;
+   }
+};
+									/*}}}*/
 static bool isDoomedItem(pkgAcquire::Item const * const Itm)
 {
    auto const TransItm = dynamic_cast<pkgAcqTransactionItem const * const>(Itm);
@@ -225,8 +293,9 @@ bool pkgAcquire::Worker::RunMessages()
       MessageType const Number = static_cast<MessageType>(strtoul(Message.c_str(),&End,10));
       if (End == Message.c_str())
 	 return _error->Error("Invalid message from method %s: %s",Access.c_str(),Message.c_str());
+      MessageFields const Fields(Message);
 
-      string URI = LookupTag(Message,"URI");
+      string URI = Fields.Find("URI");
       pkgAcquire::Queue::QItem *Itm = NULL;
       if (URI.empty() == false)
 	 Itm = OwnerQ->FindItem(URI,this);
@@ -234,7 +303,7 @@ bool pkgAcquire::Worker::RunMessages()
       if (Itm != NULL)
       {
 	 // update used mirror
-	 string UsedMirror = LookupTag(Message,"UsedMirror", "");
+	 string UsedMirror = Fields.Find("UsedMirror", "");
 	 if (UsedMirror.empty() == false)
 	 {
 	    for (pkgAcquire::Queue::QItem::owner_iterator O = Itm->Owners.begin(); O != Itm->Owners.end(); ++O)
@@ -255,11 +324,13 @@ bool pkgAcquire::Worker::RunMessages()
 
 	 case MessageType::LOG:
 	 if (Debug == true)
-	    clog << " <- (log) " << LookupTag(Message,"Message") << endl;
+	    clog << " <- (log) " << Fields.Find("Message") << endl;
 	 break;
 
 	 case MessageType::STATUS:
-	 Status = LookupTag(Message,"Message");
+	 Status = Fields.Find("Message");
+	 if (Itm != nullptr)
+	    AddResolverCache(Fields.Find("Resolver-Cache"), ::URI(Itm->URI).Host);
 	 break;
 
 	 case MessageType::REDIRECT:
@@ -270,7 +341,7 @@ bool pkgAcquire::Worker::RunMessages()
                break;
             }
 
-	    std::string const NewURI = LookupTag(Message,"New-URI",URI.c_str());
+	    std::string const NewURI = Fields.Find("New-URI",URI.c_str());
             Itm->URI = NewURI;
 
 	    ItemDone();
@@ -326,7 +397,7 @@ bool pkgAcquire::Worker::RunMessages()
          }
 
 	 case MessageType::WARNING:
-	    _error->Warning("%s: %s", Itm->Owner->DescURI().c_str(), LookupTag(Message,"Message").c_str());
+	    _error->Warning("%s: %s", Itm->Owner->DescURI().c_str(), Fields.Find("Message").c_str());
 	    break;
 
 	 case MessageType::URI_START:
@@ -339,8 +410,8 @@ bool pkgAcquire::Worker::RunMessages()
 
 	    CurrentItem = Itm;
 	    CurrentSize = 0;
-	    TotalSize = strtoull(LookupTag(Message,"Size","0").c_str(), NULL, 10);
-	    ResumePoint = strtoull(LookupTag(Message,"Resume-Point","0").c_str(), NULL, 10);
+	    TotalSize = strtoull(Fields.Find("Size","0").c_str(), NULL, 10);
+	    ResumePoint = strtoull(Fields.Find("Resume-Point","0").c_str(), NULL, 10);
 	    for (auto const Owner: Itm->Owners)
 	    {
 	       Owner->Start(Message, TotalSize);
@@ -373,13 +444,13 @@ bool pkgAcquire::Worker::RunMessages()
 
 	    HashStringList ReceivedHashes;
 	    {
-	       std::string const givenfilename = LookupTag(Message, "Filename");
+	       std::string const givenfilename = Fields.Find("Filename");
 	       std::string const filename = givenfilename.empty() ? Itm->Owner->DestFile : givenfilename;
 	       // see if we got hashes to verify
 	       for (char const * const * type = HashString::SupportedHashes(); *type != NULL; ++type)
 	       {
 		  std::string const tagname = std::string(*type) + "-Hash";
-		  std::string const hashsum = LookupTag(Message, tagname.c_str());
+		  std::string const hashsum = Fields.Find(tagname.c_str());
 		  if (hashsum.empty() == false)
 		     ReceivedHashes.push_back(HashString(*type, hashsum));
 	       }
@@ -398,15 +469,15 @@ bool pkgAcquire::Worker::RunMessages()
 
 	       // only local files can refer other filenames and counting them as fetched would be unfair
 	       if (Log != NULL && Itm->Owner->Complete == false && Itm->Owner->Local == false && givenfilename == filename)
-		  Log->Fetched(ReceivedHashes.FileSize(),atoi(LookupTag(Message,"Resume-Point","0").c_str()));
+		  Log->Fetched(ReceivedHashes.FileSize(),atoi(Fields.Find("Resume-Point","0").c_str()));
 	    }
 
 	    std::vector<Item*> const ItmOwners = Itm->Owners;
 	    OwnerQ->ItemDone(Itm);
 	    Itm = NULL;
 
-	    bool const isIMSHit = StringToBool(LookupTag(Message,"IMS-Hit"),false) ||
-	       StringToBool(LookupTag(Message,"Alt-IMS-Hit"),false);
+	    bool const isIMSHit = StringToBool(Fields.Find("IMS-Hit"),false) ||
+	       StringToBool(Fields.Find("Alt-IMS-Hit"),false);
 	    auto const forcedHash = _config->Find("Acquire::ForceHash");
 	    for (auto const Owner: ItmOwners)
 	    {
@@ -488,7 +559,7 @@ bool pkgAcquire::Worker::RunMessages()
 	 {
 	    if (Itm == nullptr)
 	    {
-	       std::string const msg = LookupTag(Message,"Message");
+	       std::string const msg = Fields.Find("Message");
 	       _error->Error("Method gave invalid 400 URI Failure message: %s", msg.c_str());
 	       break;
 	    }
@@ -506,7 +577,7 @@ bool pkgAcquire::Worker::RunMessages()
 
 	    bool errTransient = false, errAuthErr = false;
 	    {
-	       std::string const failReason = LookupTag(Message, "FailReason");
+	       std::string const failReason = Fields.Find("FailReason");
 	       {
 		  auto const reasons = { "Timeout", "ConnectionRefused",
 		     "ConnectionTimedOut", "ResolveFailure", "TmpResolveFailure" };
@@ -537,7 +608,7 @@ bool pkgAcquire::Worker::RunMessages()
 	 }
 
 	 case MessageType::GENERAL_FAILURE:
-	 _error->Error("Method %s General failure: %s",Access.c_str(),LookupTag(Message,"Message").c_str());
+	 _error->Error("Method %s General failure: %s",Access.c_str(),Fields.Find("Message").c_str());
 	 break;
 
 	 case MessageType::MEDIA_CHANGE:
@@ -564,6 +635,7 @@ bool pkgAcquire::Worker::Capabilities(string Message)
    Config->LocalOnly = StringToBool(LookupTag(Message,"Local-Only"),false);
    Config->NeedsCleanup = StringToBool(LookupTag(Message,"Needs-Cleanup"),false);
    Config->Removable = StringToBool(LookupTag(Message,"Removable"),false);
+   Config->BandwidthGrants(StringToBool(LookupTag(Message,"Bandwidth-Grants"),false));
 
    // Some debug text
    if (Debug == true)
@@ -575,7 +647,8 @@ bool pkgAcquire::Worker::Capabilities(string Message)
 	      " SendConfig:" << Config->SendConfig <<
 	      " LocalOnly: " << Config->LocalOnly <<
 	      " NeedsCleanup: " << Config->NeedsCleanup <<
-	      " Removable: " << Config->Removable << endl;
+	      " Removable: " << Config->Removable <<
+	      " BandwidthGrants: " << Config->BandwidthGrants() << endl;
    }
 
    return true;
@@ -684,6 +757,10 @@ bool pkgAcquire::Worker::QueueItem(pkgAcquire::Queue::QItem *Item)
       }
    }
 
+   std::string const Resolved = GetResolverCache();
+   if (Resolved.empty() == false)
+      Message += "\nResolver-Cache: " + Resolved;
+
    Item->SyncDestinationFiles();
    Message += Item->Custom600Headers();
    Message += "\n\n";
@@ -703,6 +780,93 @@ bool pkgAcquire::Worker::QueueItem(pkgAcquire::Queue::QItem *Item)
    return true;
 }
 									/*}}}*/
+// Worker::AddResolverCache - Remember lookups reported by a method	/*{{{*/
+// ---------------------------------------------------------------------
+/* Methods connecting to a server report the addresses (and SRV records)
+   they found, so that other methods connecting to the same server don't
+   need to ask the nameservers again. A method is only trusted with the
+   lookups for the host of the item it is fetching. */
+static bool ResolverCacheKeyForHost(std::string const &Key, std::string const &Host)
+{
+   if (Host.empty() == true)
+      return false;
+   if (APT::String::Startswith(Key, "addr:") == true)
+      return Key.compare(5, std::string::npos, Host) == 0;
+   if (APT::String::Startswith(Key, "srv:") == true)
+   {
+      size_t const Port = Key.rfind(':');
+      return Port > 4 && Key.compare(4, Port - 4, Host) == 0;
+   }
+   return false;
+}
+void pkgAcquire::Worker::AddResolverCache(std::string const &Entries, std::string const &Host)
+{
+   if (Entries.empty() == true || _config->FindI("Acquire::Resolver-Cache-Time", 300) <= 0)
+      return;
+   time_t const Now = time(nullptr);
+   for (auto const &Entry : VectorizeString(Entries, ' '))
+   {
+      size_t const Equal = Entry.find('=');
+      if (Equal == std::string::npos || Equal == 0)
+	 continue;
+      std::string const Key = Entry.substr(0, Equal);
+      if (ResolverCacheKeyForHost(Key, Host) == false)
+      {
+	 if (Debug == true)
+	    clog << " <- " << Access << ": ignored resolver cache entry " << Key << " not for " << Host << endl;
+	 continue;
+      }
+      auto &Cached = ResolverCache[Key];
+      Cached.Value = Entry.substr(Equal + 1);
+      Cached.Time = Now;
+      Cached.Serial = ++ResolverCacheSerial;
+   }
+}
+									/*}}}*/
+// Worker::GetResolverCache - Lookups this method hasn't seen yet	/*{{{*/
+// ---------------------------------------------------------------------
+/* Entries older than Acquire::Resolver-Cache-Time are dropped, so that
+   a long running acquire will not keep using outdated addresses. */
+std::string pkgAcquire::Worker::GetResolverCache()
+{
+   int const MaxAge = _config->FindI("Acquire::Resolver-Cache-Time", 300);
+   if (MaxAge <= 0 || ResolverCache.empty() == true)
+      return "";
+   time_t const Now = time(nullptr);
+   unsigned long &Sent = ResolverCacheSent[this];
+   std::string Entries;
+   for (auto Cached = ResolverCache.begin(); Cached != ResolverCache.end();)
+   {
+      if (Now - Cached->second.Time > MaxAge)
+      {
+	 Cached = ResolverCache.erase(Cached);
+	 continue;
+      }
+      if (Cached->second.Serial > Sent)
+      {
+	 if (Entries.empty() == false)
+	    Entries.append(" ");
+	 Entries.append(Cached->first).append("=").append(Cached->second.Value);
+      }
+      ++Cached;
+   }
+   Sent = ResolverCacheSerial;
+   return Entries;
+}
+									/*}}}*/
+// Worker::GrantBandwidth - Allow the method to read more data		/*{{{*/
+// ---------------------------------------------------------------------
+/* See pkgAcquire::GrantBandwidth */
+void pkgAcquire::Worker::GrantBandwidth(unsigned long long const Bytes)
+{
+   std::string Message;
+   strprintf(Message, "604 Bandwidth Grant\nBytes: %llu\n\n", Bytes);
+   if (Debug == true)
+      clog << " -> " << Access << ':' << QuoteString(Message, "\n") << endl;
+   OutQueue += Message;
+   OutReady = true;
+}
+									/*}}}*/
 // Worker::OutFdRead - Out bound FD is ready				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
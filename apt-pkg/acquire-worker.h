@@ -328,6 +328,9 @@ class pkgAcquire::Worker : public WeakPointable
 
 private:
    APT_HIDDEN void PrepareFiles(char const * const caller, pkgAcquire::Queue::QItem const * const Itm);
+   APT_HIDDEN void AddResolverCache(std::string const &Entries, std::string const &Host);
+   APT_HIDDEN std::string GetResolverCache();
+   APT_HIDDEN void GrantBandwidth(unsigned long long const Bytes);
 };
 
 /** @} */
@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <numeric>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <sstream>
@@ -50,6 +51,9 @@
 
 using namespace std;
 
+// how often the bandwidth of Acquire::Dl-Limit is handed out (in microseconds)
+static const suseconds_t BandwidthGrantInterval = 100000;
+
 // Acquire::pkgAcquire - Constructor					/*{{{*/
 // ---------------------------------------------------------------------
 /* We grab some runtime state from the configuration space */
@@ -415,6 +419,8 @@ string pkgAcquire::QueueName(string Uri,MethodConfig const *&Config)
       long cpuCount = 10;
 #endif
       cpuCount = _config->FindI("Acquire::QueueHost::Limit", cpuCount);
+      // methods doing heavy lifting locally might need a different cap
+      cpuCount = _config->FindI("Acquire::" + U.Access + "::Max-Instances", cpuCount);
 
       if (cpuCount <= 0 || existing < cpuCount)
 	 strprintf(FullQueueName, "%s%ld", AccessSchema.c_str(), existing);
@@ -476,6 +482,9 @@ pkgAcquire::MethodConfig *pkgAcquire::GetConfig(string Access)
    if (Work.Start() == false)
       return 0;
 
+   // the user can decide how many instances of a method may run
+   Conf->SingleInstance = _config->FindB("Acquire::"+Access+"::Single-Instance", Conf->SingleInstance);
+
    /* if a method uses DownloadLimit, we switch to SingleInstance mode */
    if(_config->FindI("Acquire::"+Access+"::Dl-Limit",0) > 0)
       Conf->SingleInstance = true;
@@ -669,6 +678,13 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
    
    bool WasCancelled = false;
 
+   // the bandwidth all methods together may use
+   unsigned long long const BandwidthLimit = _config->FindI("Acquire::Dl-Limit", 0) * 1024ull;
+   struct timeval LastGrant;
+   gettimeofday(&LastGrant, NULL);
+   struct timeval LastPulse = LastGrant;
+   unsigned long long Tokens = 0;
+
    // Run till all things have been acquired
    struct timeval tv;
    tv.tv_sec = 0;
@@ -681,11 +697,20 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
       FD_ZERO(&RFds);
       FD_ZERO(&WFds);
       SetFds(Highest,&RFds,&WFds);
-      
+
       int Res;
       do
       {
-	 Res = select(Highest+1,&RFds,&WFds,0,&tv);
+	 if (BandwidthLimit == 0)
+	    Res = select(Highest+1,&RFds,&WFds,0,&tv);
+	 else
+	 {
+	    // wake up in time for the next bandwidth grant
+	    struct timeval wait;
+	    wait.tv_sec = 0;
+	    wait.tv_usec = std::min<suseconds_t>(PulseIntervall, BandwidthGrantInterval);
+	    Res = select(Highest+1,&RFds,&WFds,0,&wait);
+	 }
       }
       while (Res < 0 && errno == EINTR);
       
@@ -698,9 +723,25 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
       if(RunFdsSane(&RFds,&WFds) == false)
          break;
 
+      bool Pulse = Res == 0;
+      if (BandwidthLimit != 0)
+      {
+	 GrantBandwidth(BandwidthLimit, LastGrant, Tokens);
+
+	 // select times out for the grants, so check the clock instead
+	 // as not all systems tell how much of the timeout is left
+	 struct timeval Now;
+	 gettimeofday(&Now, NULL);
+	 long long const Elapsed = (Now.tv_sec - LastPulse.tv_sec) * 1000000ll +
+	    (Now.tv_usec - LastPulse.tv_usec);
+	 Pulse = Elapsed < 0 || Elapsed >= PulseIntervall;
+      }
+
       // Timeout, notify the log class
-      if (Res == 0 || (Log != 0 && Log->Update == true))
+      if (Pulse == true || (Log != 0 && Log->Update == true))
       {
+	 if (BandwidthLimit != 0)
+	    gettimeofday(&LastPulse, NULL);
 	 tv.tv_usec = PulseIntervall;
 	 for (Worker *I = Workers; I != 0; I = I->NextAcquire)
 	    I->Pulse();
@@ -733,6 +774,59 @@ pkgAcquire::RunResult pkgAcquire::Run(int PulseIntervall)
    return Continue;
 }
 									/*}}}*/
+// Acquire::GrantBandwidth - Share the download bandwidth between workers	/*{{{*/
+// ---------------------------------------------------------------------
+/* Acquire::Dl-Limit caps the bandwidth of all methods together: a token
+   bucket is filled at that rate and emptied every BandwidthGrantInterval
+   by granting the methods which are busy with items a share of it, weighted
+   by the priority of the items they work on. A single busy method gets it
+   all. Methods which do not support grants are not limited by this. */
+void pkgAcquire::GrantBandwidth(unsigned long long const Limit, struct timeval &LastGrant,
+      unsigned long long &Tokens)
+{
+   struct timeval Now;
+   gettimeofday(&Now, NULL);
+   long long const Elapsed = (Now.tv_sec - LastGrant.tv_sec) * 1000000ll +
+      (Now.tv_usec - LastGrant.tv_usec);
+   if (Elapsed >= 0 && Elapsed < BandwidthGrantInterval)
+      return;
+   LastGrant = Now;
+   if (Elapsed < 0)
+      return;
+
+   // while nobody is downloading the bucket fills up to one second worth
+   Tokens = std::min(Limit, Tokens + Limit * Elapsed / 1000000);
+
+   std::vector<std::pair<Worker *, unsigned long long>> Busy;
+   unsigned long long TotalWeight = 0;
+   for (Queue *Q = Queues; Q != 0; Q = Q->Next)
+   {
+      for (Worker *W = Q->Workers; W != 0; W = W->NextQueue)
+      {
+	 if (W->Config == 0 || W->Config->BandwidthGrants() == false)
+	    continue;
+	 int Priority = -1;
+	 if (W->CurrentItem != 0)
+	    Priority = W->CurrentItem->GetPriority();
+	 else
+	    for (Queue::QItem *I = Q->Items; I != 0; I = I->Next)
+	       if (I->Worker == W)
+		  Priority = std::max(Priority, I->GetPriority());
+	 if (Priority < 0)
+	    continue;
+	 unsigned long long const Weight = std::max(1, Priority);
+	 Busy.emplace_back(W, Weight);
+	 TotalWeight += Weight;
+      }
+   }
+   if (TotalWeight == 0)
+      return;
+
+   for (auto const &B : Busy)
+      B.first->GrantBandwidth(Tokens * B.second / TotalWeight);
+   Tokens = 0;
+}
+									/*}}}*/
 // Acquire::Bump - Called when an item is dequeued			/*{{{*/
 // ---------------------------------------------------------------------
 /* This routine bumps idle queues in hopes that they will be able to fetch
@@ -860,16 +954,39 @@ pkgAcquire::UriIterator pkgAcquire::UriEnd()
 // Acquire::MethodConfig::MethodConfig - Constructor			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-pkgAcquire::MethodConfig::MethodConfig() : d(NULL), Next(0), SingleInstance(false),
+class pkgAcquireMethodConfigPrivate
+{
+   public:
+   bool BandwidthGrants;
+
+   pkgAcquireMethodConfigPrivate() : BandwidthGrants(false) {}
+};
+pkgAcquire::MethodConfig::MethodConfig() : d(new pkgAcquireMethodConfigPrivate), Next(0), SingleInstance(false),
    Pipeline(false), SendConfig(false), LocalOnly(false), NeedsCleanup(false),
    Removable(false)
 {
+}
+									/*}}}*/
+// Acquire::MethodConfig::BandwidthGrants - Accessors			/*{{{*/
+bool pkgAcquire::MethodConfig::BandwidthGrants() const
+{
+   return static_cast<pkgAcquireMethodConfigPrivate *>(d)->BandwidthGrants;
+}
+void pkgAcquire::MethodConfig::BandwidthGrants(bool const Grants)
+{
+   static_cast<pkgAcquireMethodConfigPrivate *>(d)->BandwidthGrants = Grants;
 }
 									/*}}}*/
 // Queue::Queue - Constructor						/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-pkgAcquire::Queue::Queue(string const &name,pkgAcquire * const owner) : d(NULL), Next(0),
+class pkgAcquireQueuePrivate
+{
+   public:
+   // the time each item was placed in the queue for Debug::pkgAcquire::Queue
+   std::unordered_map<void const *, struct timeval> EnqueueTimes;
+};
+pkgAcquire::Queue::Queue(string const &name,pkgAcquire * const owner) : d(new pkgAcquireQueuePrivate), Next(0),
    Name(name), Items(0), Workers(0), Owner(owner), PipeDepth(0), MaxPipeDepth(1)
 {
 }
@@ -887,13 +1004,23 @@ pkgAcquire::Queue::~Queue()
       Items = Items->Next;
       delete Jnk;
    }
+   delete static_cast<pkgAcquireQueuePrivate *>(d);
 }
 									/*}}}*/
 // Queue::Enqueue - Queue an item to the queue				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
+static bool QueueBeforeBySize(unsigned long long const Queued, unsigned long long const New)
+{
+   // unknown sizes (0) sort after all known sizes, but keep arrival order
+   if (New == 0)
+      return true;
+   return Queued != 0 && Queued <= New;
+}
 bool pkgAcquire::Queue::Enqueue(ItemDesc &Item)
 {
+   bool const OrderBySize = _config->Find("Acquire::Queue-Order", "fifo") == "size";
+   int const ItemPriority = Item.Owner->Priority();
    QItem **OptimalI = &Items;
    QItem **I = &Items;
    // move to the end of the queue and check for duplicates here
@@ -907,11 +1034,16 @@ bool pkgAcquire::Queue::Enqueue(ItemDesc &Item)
 	 return false;
       }
       // Determine the optimal position to insert: before anything with a
-      // higher priority.
-      int priority = (*I)->GetPriority();
+      // lower priority and, if requested, before bigger items of the same
+      // priority, so that small items are done early instead of waiting
+      // behind big ones which just happened to be queued first.
+      int const priority = (*I)->GetPriority();
+      bool InsertAfter = priority >= ItemPriority;
+      if (OrderBySize == true && priority == ItemPriority)
+	 InsertAfter = QueueBeforeBySize((*I)->GetMaximumSize(), Item.Owner->FileSize);
 
       I = &(*I)->Next;
-      if (priority >= Item.Owner->Priority()) {
+      if (InsertAfter) {
 	 OptimalI = I;
       }
    }
@@ -920,6 +1052,7 @@ bool pkgAcquire::Queue::Enqueue(ItemDesc &Item)
    // Create a new item
    QItem *Itm = new QItem;
    *Itm = Item;
+   gettimeofday(&static_cast<pkgAcquireQueuePrivate *>(d)->EnqueueTimes[Itm], nullptr);
    Itm->Next = *OptimalI;
    *OptimalI = Itm;
    
@@ -947,6 +1080,7 @@ bool pkgAcquire::Queue::Dequeue(Item *Owner)
 	 QItem *Jnk= *I;
 	 *I = (*I)->Next;
 	 Owner->QueueCounter--;
+	 static_cast<pkgAcquireQueuePrivate *>(d)->EnqueueTimes.erase(Jnk);
 	 delete Jnk;
 	 Res = true;
       }
@@ -1089,6 +1223,16 @@ bool pkgAcquire::Queue::Cycle()
       // the queue is idle
       if (I->GetPriority() < ActivePriority)
 	 return true;
+      if (_config->FindB("Debug::pkgAcquire::Queue", false) == true)
+      {
+	 struct timeval Now;
+	 gettimeofday(&Now, nullptr);
+	 struct timeval const &Enqueued = static_cast<pkgAcquireQueuePrivate *>(d)->EnqueueTimes[I];
+	 long long const Waited = (Now.tv_sec - Enqueued.tv_sec) * 1000LL +
+	    (Now.tv_usec - Enqueued.tv_usec) / 1000;
+	 std::clog << " @ Queue " << Name << ": " << I->URI << " waited " << Waited << "ms"
+	    << " (priority " << I->GetPriority() << ", size " << I->GetMaximumSize() << ")" << std::endl;
+      }
       I->Worker = Workers;
       for (auto const &O: I->Owners)
 	 O->Status = pkgAcquire::Item::StatFetching;
@@ -1407,5 +1551,8 @@ pkgAcquire::UriIterator::UriIterator(pkgAcquire::Queue *Q) : d(NULL), CurQ(Q), C
 }
 
 APT_CONST pkgAcquire::UriIterator::~UriIterator() {}
-APT_CONST pkgAcquire::MethodConfig::~MethodConfig() {}
+pkgAcquire::MethodConfig::~MethodConfig()
+{
+   delete static_cast<pkgAcquireMethodConfigPrivate *>(d);
+}
 APT_CONST pkgAcquireStatus::~pkgAcquireStatus() {}
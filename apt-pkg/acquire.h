@@ -390,6 +390,8 @@ class pkgAcquire
 
    private:
    APT_HIDDEN void Initialize();
+   APT_HIDDEN void GrantBandwidth(unsigned long long const Limit, struct timeval &LastGrant,
+	 unsigned long long &Tokens);
 };
 
 /** \brief Represents a single download source from which an item
@@ -687,6 +689,12 @@ struct pkgAcquire::MethodConfig
     */
    MethodConfig();
 
+   /** \brief If \b true, this fetch method reads only as much data as it
+    *  was granted by 604 Bandwidth Grant messages (see Acquire::Dl-Limit).
+    */
+   APT_HIDDEN bool BandwidthGrants() const;
+   APT_HIDDEN void BandwidthGrants(bool const Grants);
+
    virtual ~MethodConfig();
 };
 									/*}}}*/
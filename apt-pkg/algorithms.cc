@@ -32,6 +32,12 @@
 #include <cstdlib>
 #include <iostream>
 #include <utility>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <unordered_map>
+#include <vector>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -393,10 +399,89 @@ bool pkgFixBroken(pkgDepCache &Cache)
    return Fix.Resolve(true);
 }
 									/*}}}*/
+class APT_HIDDEN pkgProblemResolverPrivate
+{
+public:
+   /* The scores are kept between the runs of the resolver, so only the parts
+      of them depending on packages which changed since the last run have
+      to be calculated again. */
+   std::vector<int> Settings;
+   // states of the packages the scores were calculated with
+   std::vector<pkgCache::Version *> InstallVer;
+   std::vector<pkgCache::Version *> CandidateVer;
+   std::vector<bool> Protected;
+   // parts of a score, the base score is Own + Depended
+   std::vector<int> Own;
+   std::vector<int> Depended;
+   std::vector<int> RevDepends;
+   std::vector<int> ProvidedBefore;
+   std::vector<int> ProvidedAfter;
+   std::vector<int> Scores;
+   // dependencies of install versions counted in Depended of their target
+   std::vector<bool> Counted;
+   // points each provides gave to its owner
+   std::unordered_map<unsigned long, int> Provided;
+   // the provides are propagated in the order the packages are iterated in
+   std::vector<pkgCache::Package *> Order;
+   std::vector<unsigned long> Position;
+   // packages by their ID
+   std::vector<pkgCache::Package *> Packages;
+
+   // packages with a score to sum up again in this run with their old state
+   std::vector<pkgCache::Package *> Touched;
+   std::vector<bool> IsTouched;
+   std::vector<int> OldBase;
+   std::vector<pkgCache::Version *> OldInstallVer;
+   std::vector<bool> Queued;
+
+   int Base(map_id_t const ID) const { return Own[ID] + Depended[ID]; }
+
+   void Touch(pkgCache::PkgIterator Pkg)
+   {
+      if (IsTouched[Pkg->ID] == true)
+	 return;
+      IsTouched[Pkg->ID] = true;
+      OldBase[Pkg->ID] = Base(Pkg->ID);
+      OldInstallVer[Pkg->ID] = InstallVer[Pkg->ID];
+      Touched.push_back(Pkg);
+   }
+
+   void Reset(pkgCache &Cache)
+   {
+      unsigned long const Size = Cache.Head().PackageCount;
+      InstallVer.assign(Size, nullptr);
+      CandidateVer.assign(Size, nullptr);
+      Protected.assign(Size, false);
+      Own.assign(Size, 0);
+      Depended.assign(Size, 0);
+      RevDepends.assign(Size, 0);
+      ProvidedBefore.assign(Size, 0);
+      ProvidedAfter.assign(Size, 0);
+      Scores.assign(Size, 0);
+      Counted.assign(Cache.Head().DependsCount, false);
+      Provided.clear();
+      Touched.clear();
+      IsTouched.assign(Size, false);
+      OldBase.assign(Size, 0);
+      OldInstallVer.assign(Size, nullptr);
+      Queued.assign(Size, false);
+
+      Order.clear();
+      Order.reserve(Size);
+      Position.assign(Size, 0);
+      Packages.assign(Size, nullptr);
+      for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
+      {
+	 Position[I->ID] = Order.size();
+	 Order.push_back(I);
+	 Packages[I->ID] = I;
+      }
+   }
+};
 // ProblemResolver::pkgProblemResolver - Constructor			/*{{{*/
 // ---------------------------------------------------------------------
 /* */
-pkgProblemResolver::pkgProblemResolver(pkgDepCache *pCache) : d(NULL), Cache(*pCache)
+pkgProblemResolver::pkgProblemResolver(pkgDepCache *pCache) : d(new pkgProblemResolverPrivate()), Cache(*pCache)
 {
    // Allocate memory
    unsigned long Size = Cache.Head().PackageCount;
@@ -415,6 +500,7 @@ pkgProblemResolver::~pkgProblemResolver()
 {
    delete [] Scores;
    delete [] Flags;
+   delete d;
 }
 									/*}}}*/
 // ProblemResolver::ScoreSort - Sort the list by score			/*{{{*/
@@ -435,7 +521,6 @@ int pkgProblemResolver::ScoreSort(Package const *A,Package const *B)
 void pkgProblemResolver::MakeScores()
 {
    unsigned long Size = Cache.Head().PackageCount;
-   memset(Scores,0,sizeof(*Scores)*Size);
 
    // maps to pkgCache::State::VerPriority: 
    //    Required Important Standard Optional Extra
@@ -485,14 +570,57 @@ void pkgProblemResolver::MakeScores()
          << "  AddProtected => " << AddProtected << endl
          << "  AddEssential => " << AddEssential << endl;
 
+   std::vector<int> Settings(std::begin(PrioMap), std::end(PrioMap));
+   Settings.insert(Settings.end(), std::begin(DepMap), std::end(DepMap));
+   Settings.insert(Settings.end(), {PrioEssentials, PrioInstalledAndNotObsolete, AddProtected, AddEssential});
+   bool const Full = (d->Settings != Settings);
+   if (Full == true)
+   {
+      d->Settings.swap(Settings);
+      d->Reset(Cache.GetCache());
+   }
+
+   // Find the packages changed since the last run – all of them in the first.
+   // They are checked in the order of their IDs as all the states are stored in it.
+   std::vector<pkgCache::Package *> Changed;
+   for (map_id_t ID = 0; ID < Size; ++ID)
+   {
+      pkgCache::PkgIterator I(Cache, d->Packages[ID]);
+      if (Full == false && Cache[I].InstallVer == d->InstallVer[ID] &&
+	  Cache[I].CandidateVer == d->CandidateVer[ID] &&
+	  ((Flags[ID] & Protected) != 0) == d->Protected[ID])
+	 continue;
+      Changed.push_back(I);
+   }
+
+   // Remove the points the old install versions gave along their dependencies
+   for (auto const P : Changed)
+   {
+      pkgCache::PkgIterator const I(Cache, P);
+      pkgCache::VerIterator const OldVer(Cache, d->InstallVer[I->ID]);
+      if (OldVer.end() == true || OldVer == Cache[I].InstVerIter(Cache))
+	 continue;
+      for (pkgCache::DepIterator D = OldVer.DependsList(); D.end() == false; ++D)
+      {
+	 if (d->Counted[D->ID] == false)
+	    continue;
+	 d->Counted[D->ID] = false;
+	 pkgCache::PkgIterator const T = D.TargetPkg();
+	 d->Touch(T);
+	 d->Depended[T->ID] -= DepMap[D->Type];
+      }
+   }
+
    // Generate the base scores for a package based on its properties
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
+   for (auto const P : Changed)
    {
+      pkgCache::PkgIterator I(Cache, P);
+      d->Touch(I);
+      int &Score = d->Own[I->ID];
+      Score = 0;
       if (Cache[I].InstallVer == 0)
 	 continue;
-      
-      int &Score = Scores[I->ID];
-      
+
       /* This is arbitrary, it should be high enough to elevate an
          essantial package above most other packages but low enough
 	 to allow an obsolete essential packages to be removed by
@@ -515,6 +643,9 @@ void pkgProblemResolver::MakeScores()
       if (I->CurrentVer != 0 && Cache[I].CandidateVer != 0 && Cache[I].CandidateVerIter(Cache).Downloadable())
 	 Score += PrioInstalledAndNotObsolete;
 
+      if (d->OldInstallVer[I->ID] == Cache[I].InstallVer)
+	 continue;
+
       // propagate score points along dependencies
       for (pkgCache::DepIterator D = InstVer.DependsList(); D.end() == false; ++D)
       {
@@ -527,61 +658,151 @@ void pkgProblemResolver::MakeScores()
 	    if (IV.end() == true || D.IsSatisfied(IV) == false)
 	       continue;
 	 }
-	 Scores[T->ID] += DepMap[D->Type];
+	 d->Counted[D->ID] = true;
+	 d->Touch(T);
+	 d->Depended[T->ID] += DepMap[D->Type];
       }
    }
 
-   // Copy the scores to advoid additive looping
-   std::unique_ptr<int[]> OldScores(new int[Size]);
-   memcpy(OldScores.get(),Scores,sizeof(*Scores)*Size);
-      
+   /* Versioned dependencies of unchanged packages on packages with
+      a new install version might be satisfied differently now */
+   for (auto const P : Changed)
+   {
+      pkgCache::PkgIterator T(Cache, P);
+      if (Full == true || d->OldInstallVer[T->ID] == Cache[T].InstallVer)
+	 continue;
+      pkgCache::VerIterator const IV = Cache[T].InstVerIter(Cache);
+      for (pkgCache::DepIterator D = T.RevDependsList(); D.end() == false; ++D)
+      {
+	 if (D->Version == 0 || DepMap[D->Type] == 0 ||
+	     (pkgCache::Version *)D.ParentVer() != Cache[D.ParentPkg()].InstallVer)
+	    continue;
+	 bool const Satisfied = IV.end() == false && D.IsSatisfied(IV) == true;
+	 if (Satisfied == d->Counted[D->ID])
+	    continue;
+	 d->Counted[D->ID] = Satisfied;
+	 d->Depended[T->ID] += Satisfied ? DepMap[D->Type] : -DepMap[D->Type];
+      }
+   }
+
+   std::priority_queue<unsigned long, std::vector<unsigned long>, std::greater<unsigned long> > Queue;
+   auto const Enqueue = [&](pkgCache::PkgIterator const &Pkg) {
+      if (d->Queued[Pkg->ID] == true)
+	 return;
+      d->Queued[Pkg->ID] = true;
+      Queue.push(d->Position[Pkg->ID]);
+   };
+
    /* Now we cause 1 level of dependency inheritance, that is we add the 
       score of the packages that depend on the target Package. This 
       fortifies high scoring packages */
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
+   auto const Inherit = [&](pkgCache::Version * const Ver, int const Points) {
+      if (Ver == 0 || Points == 0)
+	 return;
+      for (pkgCache::DepIterator D = pkgCache::VerIterator(Cache, Ver).DependsList(); D.end() == false; ++D)
+      {
+	 if (D->Type != pkgCache::Dep::Depends &&
+	     D->Type != pkgCache::Dep::PreDepends &&
+	     D->Type != pkgCache::Dep::Recommends)
+	    continue;
+	 pkgCache::PkgIterator const T = D.TargetPkg();
+	 d->Touch(T);
+	 d->RevDepends[T->ID] += Points;
+	 Enqueue(T);
+      }
+   };
+   for (size_t i = 0, Count = d->Touched.size(); i < Count; ++i)
    {
-      if (Cache[I].InstallVer == 0)
-	 continue;
-      
-      for (pkgCache::DepIterator D = I.RevDependsList(); D.end() == false; ++D)
+      pkgCache::PkgIterator I(Cache, d->Touched[i]);
+      pkgCache::Version * const OldVer = d->OldInstallVer[I->ID];
+      pkgCache::Version * const Ver = Cache[I].InstallVer;
+      // Do not propagate negative scores otherwise
+      // an extra (-2) package might score better than an optional (-1)
+      int const OldPoints = std::max(d->OldBase[I->ID], 0);
+      int const Points = std::max(d->Base(I->ID), 0);
+      if (OldVer == Ver)
       {
-	 // Only do it for the install version
-	 if ((pkgCache::Version *)D.ParentVer() != Cache[D.ParentPkg()].InstallVer ||
-	     (D->Type != pkgCache::Dep::Depends && 
-	      D->Type != pkgCache::Dep::PreDepends &&
-	      D->Type != pkgCache::Dep::Recommends))
-	    continue;	 
-	 
-	 // Do not propagate negative scores otherwise
-	 // an extra (-2) package might score better than an optional (-1)
-	 if (OldScores[D.ParentPkg()->ID] > 0)
-	     Scores[I->ID] += OldScores[D.ParentPkg()->ID];
-      }      
+	 Inherit(Ver, Points - OldPoints);
+	 continue;
+      }
+      Inherit(OldVer, -OldPoints);
+      Inherit(Ver, Points);
+
+      // the provides of both versions switched between being used or not
+      Enqueue(I);
+      if (OldVer != 0)
+	 for (pkgCache::PrvIterator Prv = pkgCache::VerIterator(Cache, OldVer).ProvidesList(); Prv.end() == false; ++Prv)
+	    Enqueue(Prv.ParentPkg());
+      if (Ver != 0)
+	 for (pkgCache::PrvIterator Prv = Cache[I].InstVerIter(Cache).ProvidesList(); Prv.end() == false; ++Prv)
+	    Enqueue(Prv.ParentPkg());
    }
+   auto const Inherited = [&](pkgCache::PkgIterator const &Pkg) {
+      return Cache[Pkg].InstallVer == 0 ? 0 : d->RevDepends[Pkg->ID];
+   };
 
    /* Now we propagate along provides. This makes the packages that
-      provide important packages extremely important */
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
+      provide important packages extremely important. A provided package
+      passes on the points it got so far, so only the packages providing
+      changed packages are visited again in the usual order. */
+   while (Queue.empty() == false)
    {
+      pkgCache::PkgIterator I(Cache, d->Order[Queue.top()]);
+      Queue.pop();
+      d->Queued[I->ID] = false;
+      d->Touch(I);
+      int Score = Inherited(I) + d->ProvidedBefore[I->ID];
       for (pkgCache::PrvIterator P = I.ProvidesList(); P.end() == false; ++P)
       {
+	 pkgCache::PkgIterator const Owner = P.OwnerPkg();
+	 int Points = 0;
 	 // Only do it once per package
-	 if ((pkgCache::Version *)P.OwnerVer() != Cache[P.OwnerPkg()].InstallVer)
+	 if ((pkgCache::Version *)P.OwnerVer() == Cache[Owner].InstallVer)
+	    Points = abs(Score);
+	 if (Owner == I)
+	    Score += Points;
+
+	 auto const Old = d->Provided.find(P.Index());
+	 int const OldPoints = (Old == d->Provided.end()) ? 0 : Old->second;
+	 if (Points == OldPoints)
 	    continue;
-	 Scores[P.OwnerPkg()->ID] += abs(Scores[I->ID] - OldScores[I->ID]);
+	 if (Points == 0)
+	    d->Provided.erase(Old);
+	 else
+	    d->Provided[P.Index()] = Points;
+	 d->Touch(Owner);
+	 if (d->Position[Owner->ID] > d->Position[I->ID])
+	 {
+	    d->ProvidedBefore[Owner->ID] += Points - OldPoints;
+	    Enqueue(Owner);
+	 }
+	 else
+	    d->ProvidedAfter[Owner->ID] += Points - OldPoints;
       }
    }
 
    /* Protected things are pushed really high up. This number should put them
       ahead of everything */
-   for (pkgCache::PkgIterator I = Cache.PkgBegin(); I.end() == false; ++I)
+   for (auto const P : d->Touched)
    {
+      pkgCache::PkgIterator I(Cache, P);
+      int &Score = d->Scores[I->ID];
+      Score = d->Base(I->ID) + Inherited(I) + d->ProvidedBefore[I->ID] + d->ProvidedAfter[I->ID];
       if ((Flags[I->ID] & Protected) != 0)
-	 Scores[I->ID] += AddProtected;
+	 Score += AddProtected;
       if ((I->Flags & pkgCache::Flag::Essential) == pkgCache::Flag::Essential ||
           (I->Flags & pkgCache::Flag::Important) == pkgCache::Flag::Important)
-	 Scores[I->ID] += AddEssential;
+	 Score += AddEssential;
+
+      d->InstallVer[I->ID] = Cache[I].InstallVer;
+      d->CandidateVer[I->ID] = Cache[I].CandidateVer;
+      d->Protected[I->ID] = (Flags[I->ID] & Protected) != 0;
+      d->IsTouched[I->ID] = false;
    }
+   d->Touched.clear();
+
+   // the resolver changes the scores while it works, so it gets a copy
+   memcpy(Scores, d->Scores.data(), sizeof(*Scores)*Size);
 }
 									/*}}}*/
 // ProblemResolver::DoUpgrade - Attempt to upgrade this package		/*{{{*/
@@ -99,11 +99,11 @@ private:
    virtual ~pkgSimulate();
 };
 									/*}}}*/
+class pkgProblemResolverPrivate;
 class pkgProblemResolver						/*{{{*/
 {
  private:
-   /** \brief dpointer placeholder (for later in case we need it) */
-   void * const d;
+   pkgProblemResolverPrivate * const d;
 
    pkgDepCache &Cache;
    typedef pkgCache::PkgIterator PkgIterator;
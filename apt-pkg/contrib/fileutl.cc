@@ -71,6 +71,10 @@
 
 #if __gnu_linux__
 #include <sys/prctl.h>
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 #endif
 
 #include <apti18n.h>
@@ -156,6 +160,70 @@ bool RunScripts(const char *Cnf)
 }
 									/*}}}*/
 
+// CopyFileInKernel - Copy plain files without reading them		/*{{{*/
+// ---------------------------------------------------------------------
+/* If both files are uncompressed regular files, the kernel can copy the
+   data without passing it through userspace – or on filesystems like
+   btrfs and xfs just share the extents between the files. Copying starts
+   at the current offsets and ends with both at the end as a buffered copy
+   would, but if it can't be done for these files, nothing is copied. */
+enum class KernelCopy { Done, Unsupported, Failed };
+static KernelCopy CopyFileInKernel(FileFd &From,FileFd &To)
+{
+#if defined HAVE_COPY_FILE_RANGE || defined FICLONE
+   if (From.IsCompressed() == true || To.IsCompressed() == true)
+      return KernelCopy::Unsupported;
+   int const FromFd = From.Fd();
+   int const ToFd = To.Fd();
+   struct stat FromStat, ToStat;
+   if (fstat(FromFd, &FromStat) != 0 || fstat(ToFd, &ToStat) != 0 ||
+	 S_ISREG(FromStat.st_mode) == false || S_ISREG(ToStat.st_mode) == false)
+      return KernelCopy::Unsupported;
+
+   // neither data buffered for reading nor for writing is visible to the kernel
+   if (To.Flush() == false)
+      return KernelCopy::Failed;
+   off_t const FromPos = lseek(FromFd, 0, SEEK_CUR);
+   off_t const ToPos = lseek(ToFd, 0, SEEK_CUR);
+   if (FromPos < 0 || ToPos < 0 ||
+	 static_cast<unsigned long long>(FromPos) != From.Tell() ||
+	 static_cast<unsigned long long>(ToPos) != To.Tell())
+      return KernelCopy::Unsupported;
+
+#ifdef FICLONE
+   if (FromPos == 0 && ToPos == 0 && ToStat.st_size == 0 && ioctl(ToFd, FICLONE, FromFd) == 0)
+   {
+      // the clone leaves the offsets untouched
+      if (lseek(FromFd, 0, SEEK_END) < 0 || lseek(ToFd, 0, SEEK_END) < 0)
+      {
+	 _error->Errno("lseek", "Failed to seek after cloning %s to %s", From.Name().c_str(), To.Name().c_str());
+	 return KernelCopy::Failed;
+      }
+      return KernelCopy::Done;
+   }
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+   for (bool First = true;; First = false)
+   {
+      ssize_t const Res = copy_file_range(FromFd, nullptr, ToFd, nullptr, 1 << 30, 0);
+      if (Res > 0)
+	 continue;
+      else if (Res == 0)
+	 // some pseudo-files claim to be empty, so let a read() decide
+	 return First ? KernelCopy::Unsupported : KernelCopy::Done;
+      else if (errno == EINTR)
+	 continue;
+      else if (First && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+	       errno == EOPNOTSUPP || errno == EBADF || errno == EPERM))
+	 return KernelCopy::Unsupported;
+      _error->Errno("copy_file_range", "Failed to copy %s to %s", From.Name().c_str(), To.Name().c_str());
+      return KernelCopy::Failed;
+   }
+#endif
+#endif
+   return KernelCopy::Unsupported;
+}
+									/*}}}*/
 // CopyFile - Buffered copy of a file					/*{{{*/
 // ---------------------------------------------------------------------
 /* The caller is expected to set things so that failure causes erasure */
@@ -165,6 +233,13 @@ bool CopyFile(FileFd &From,FileFd &To)
 	 From.Failed() == true || To.Failed() == true)
       return false;
 
+   switch (CopyFileInKernel(From, To))
+   {
+      case KernelCopy::Done: return true;
+      case KernelCopy::Failed: return false;
+      case KernelCopy::Unsupported: break;
+   }
+
    // Buffered copy between fds
    constexpr size_t BufSize = APT_BUFFER_SIZE;
    std::unique_ptr<unsigned char[]> Buf(new unsigned char[BufSize]);
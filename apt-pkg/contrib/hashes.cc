@@ -315,16 +315,25 @@ bool Hashes::Add(const unsigned char * const Data, unsigned long long const Size
    if (Size == 0)
       return true;
    bool Res = true;
+   /* Feed the data in chunks small enough to stay in the L1 cache while all
+      the requested digests are run over it instead of streaming the whole
+      buffer through the cache once per digest */
+   static unsigned long long const ChunkSize = 16 * 1024;
+   for (unsigned long long Done = 0; Done < Size; Done += ChunkSize)
+   {
+      unsigned char const * const Chunk = Data + Done;
+      unsigned long long const Len = std::min(Size - Done, ChunkSize);
 APT_IGNORE_DEPRECATED_PUSH
-   if ((d->CalcHashes & MD5SUM) == MD5SUM)
-      Res &= MD5.Add(Data, Size);
-   if ((d->CalcHashes & SHA1SUM) == SHA1SUM)
-      Res &= SHA1.Add(Data, Size);
-   if ((d->CalcHashes & SHA256SUM) == SHA256SUM)
-      Res &= SHA256.Add(Data, Size);
-   if ((d->CalcHashes & SHA512SUM) == SHA512SUM)
-      Res &= SHA512.Add(Data, Size);
+      if ((d->CalcHashes & MD5SUM) == MD5SUM)
+	 Res &= MD5.Add(Chunk, Len);
+      if ((d->CalcHashes & SHA1SUM) == SHA1SUM)
+	 Res &= SHA1.Add(Chunk, Len);
+      if ((d->CalcHashes & SHA256SUM) == SHA256SUM)
+	 Res &= SHA256.Add(Chunk, Len);
+      if ((d->CalcHashes & SHA512SUM) == SHA512SUM)
+	 Res &= SHA512.Add(Chunk, Len);
 APT_IGNORE_DEPRECATED_POP
+   }
    d->FileSize += Size;
    return Res;
 }
@@ -335,7 +344,7 @@ bool Hashes::Add(const unsigned char * const Data, unsigned long long const Size
 }
 bool Hashes::AddFD(int const Fd,unsigned long long Size)
 {
-   unsigned char Buf[64*64];
+   unsigned char Buf[64*1024];
    bool const ToEOF = (Size == UntilEOF);
    while (Size != 0 || ToEOF)
    {
@@ -359,7 +368,7 @@ bool Hashes::AddFD(int const Fd,unsigned long long Size, unsigned int const Hash
 }
 bool Hashes::AddFD(FileFd &Fd,unsigned long long Size)
 {
-   unsigned char Buf[64*64];
+   unsigned char Buf[64*1024];
    bool const ToEOF = (Size == 0);
    while (Size != 0 || ToEOF)
    {
@@ -35,6 +35,13 @@
 
 #include <stdint.h>
 #include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SHA1_X86_SHA_EXTENSIONS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 									/*}}}*/
 
 // SHA1Transform - Alters an existing SHA-1 hash			/*{{{*/
@@ -174,6 +181,101 @@ static void SHA1Transform(uint32_t state[5],uint8_t const buffer[64])
    state[4] += e;   
 }
 									/*}}}*/
+#ifdef SHA1_X86_SHA_EXTENSIONS
+// SHA1TransformX86 - SHA1Transform using the x86 SHA extensions	/*{{{*/
+// ---------------------------------------------------------------------
+/* Processors implementing the SHA extensions have instructions doing four
+   rounds and the message expansion, so use them if cpuid says we can. */
+static bool SHA1HasX86Extensions()
+{
+   unsigned int eax, ebx, ecx, edx;
+   if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 ||
+	 (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+      return false;
+   if (__get_cpuid_max(0, nullptr) < 7)
+      return false;
+   __cpuid_count(7, 0, eax, ebx, ecx, edx);
+   // CPUID.(EAX=07H, ECX=0):EBX.SHA[bit 29]
+   return (ebx & (1u << 29)) != 0;
+}
+static bool SHA1UseX86Extensions()
+{
+   static bool const Available = SHA1HasX86Extensions();
+   return Available;
+}
+
+/* Four rounds with the words in msg, the first group starts from e */
+#define X86R0(msg) e0 = _mm_add_epi32(e0, msg); e1 = abcd; \
+   abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+#define X86R(ein,eout,msg,f) ein = _mm_sha1nexte_epu32(ein, msg); \
+   eout = abcd; abcd = _mm_sha1rnds4_epu32(abcd, ein, f);
+/* Message expansion steps for the words in the given registers */
+#define X86M1(prev,msg) prev = _mm_sha1msg1_epu32(prev, msg);
+#define X86M2(next,msg) next = _mm_sha1msg2_epu32(next, msg);
+#define X86MX(prev,msg) prev = _mm_xor_si128(prev, msg);
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void SHA1TransformX86(uint32_t state[5],uint8_t const *buffer,size_t blocks)
+{
+   __m128i const mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+   __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i const *)state), 0x1B);
+   __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+   __m128i e1, m0, m1, m2, m3;
+
+   for (; blocks > 0; --blocks, buffer += 64)
+   {
+      __m128i const abcd_save = abcd;
+      __m128i const e0_save = e0;
+
+      m0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(buffer + 0)), mask);
+      m1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(buffer + 16)), mask);
+      m2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(buffer + 32)), mask);
+      m3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *)(buffer + 48)), mask);
+
+      X86R0(m0);
+      X86R(e1,e0,m1,0); X86M1(m0,m1);
+      X86R(e0,e1,m2,0); X86M1(m1,m2); X86MX(m0,m2);
+      X86R(e1,e0,m3,0); X86M2(m0,m3); X86M1(m2,m3); X86MX(m1,m3);
+      X86R(e0,e1,m0,0); X86M2(m1,m0); X86M1(m3,m0); X86MX(m2,m0);
+      X86R(e1,e0,m1,1); X86M2(m2,m1); X86M1(m0,m1); X86MX(m3,m1);
+      X86R(e0,e1,m2,1); X86M2(m3,m2); X86M1(m1,m2); X86MX(m0,m2);
+      X86R(e1,e0,m3,1); X86M2(m0,m3); X86M1(m2,m3); X86MX(m1,m3);
+      X86R(e0,e1,m0,1); X86M2(m1,m0); X86M1(m3,m0); X86MX(m2,m0);
+      X86R(e1,e0,m1,1); X86M2(m2,m1); X86M1(m0,m1); X86MX(m3,m1);
+      X86R(e0,e1,m2,2); X86M2(m3,m2); X86M1(m1,m2); X86MX(m0,m2);
+      X86R(e1,e0,m3,2); X86M2(m0,m3); X86M1(m2,m3); X86MX(m1,m3);
+      X86R(e0,e1,m0,2); X86M2(m1,m0); X86M1(m3,m0); X86MX(m2,m0);
+      X86R(e1,e0,m1,2); X86M2(m2,m1); X86M1(m0,m1); X86MX(m3,m1);
+      X86R(e0,e1,m2,2); X86M2(m3,m2); X86M1(m1,m2); X86MX(m0,m2);
+      X86R(e1,e0,m3,3); X86M2(m0,m3); X86M1(m2,m3); X86MX(m1,m3);
+      X86R(e0,e1,m0,3); X86M2(m1,m0); X86M1(m3,m0); X86MX(m2,m0);
+      X86R(e1,e0,m1,3); X86M2(m2,m1); X86MX(m3,m1);
+      X86R(e0,e1,m2,3); X86M2(m3,m2);
+      X86R(e1,e0,m3,3);
+
+      e0 = _mm_sha1nexte_epu32(e0, e0_save);
+      abcd = _mm_add_epi32(abcd, abcd_save);
+   }
+
+   _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+   state[4] = _mm_extract_epi32(e0, 3);
+}
+									/*}}}*/
+#endif
+// SHA1Blocks - Run SHA1Transform over a number of 64 byte blocks	/*{{{*/
+static void SHA1Blocks(uint32_t state[5],uint8_t const *buffer,size_t blocks)
+{
+#ifdef SHA1_X86_SHA_EXTENSIONS
+   if (SHA1UseX86Extensions())
+   {
+      SHA1TransformX86(state, buffer, blocks);
+      return;
+   }
+#endif
+   for (; blocks > 0; --blocks, buffer += 64)
+      SHA1Transform(state, buffer);
+}
+									/*}}}*/
 
 // SHA1Summation::SHA1Summation - Constructor                           /*{{{*/
 // ---------------------------------------------------------------------
@@ -258,11 +360,10 @@ bool SHA1Summation::Add(const unsigned char *data,unsigned long long len)
    if ((j + len) > 63)
    {
       memcpy(&buffer[j],data,(i = 64 - j));
-      SHA1Transform(state,buffer);
-      for (; i + 63 < len; i += 64)
-      {
-	 SHA1Transform(state,&data[i]);
-      }
+      SHA1Blocks(state,buffer,1);
+      size_t const blocks = (len - i) / 64;
+      SHA1Blocks(state,&data[i],blocks);
+      i += blocks * 64;
       j = 0;
    }
    else
@@ -38,6 +38,19 @@
 #include <assert.h>	/* assert() */
 #include "sha2_internal.h"
 
+/*
+ * x86 processors implementing the SHA extensions can calculate the
+ * SHA-256 compression function in hardware. The instructions are used
+ * if the compiler knows about them and cpuid says the running processor
+ * supports them, the portable code below is used otherwise.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SHA2_X86_SHA_EXTENSIONS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /*
  * ASSERT NOTE:
  * Some sanity checking code is included using assert().  On my FreeBSD
@@ -232,6 +245,7 @@ typedef u_int64_t sha2_word64;	/* Exactly 8 bytes */
  */
 static void SHA512_Last(SHA512_CTX*);
 static void SHA256_Transform(SHA256_CTX*, const sha2_word32*);
+static void SHA256_Transform_Portable(SHA256_CTX*, const sha2_word32*);
 static void SHA512_Transform(SHA512_CTX*, const sha2_word64*);
 
 
@@ -390,7 +404,7 @@ void SHA256_Init(SHA256_CTX* context) {
 	(h) = T1 + Sigma0_256(a) + Maj((a), (b), (c)); \
 	j++
 
-static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_Portable(SHA256_CTX* context, const sha2_word32* data) {
 	sha2_word32	a, b, c, d, e, f, g, h, s0, s1;
 	sha2_word32	T1, *W256;
 	int		j;
@@ -448,7 +462,7 @@ static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #else /* SHA2_UNROLL_TRANSFORM */
 
-static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+static void SHA256_Transform_Portable(SHA256_CTX* context, const sha2_word32* data) {
 	sha2_word32	a, b, c, d, e, f, g, h, s0, s1;
 	sha2_word32	T1, T2, *W256;
 	int		j;
@@ -528,6 +542,125 @@ static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 
 #endif /* SHA2_UNROLL_TRANSFORM */
 
+#ifdef SHA2_X86_SHA_EXTENSIONS
+static bool SHA256_HasX86Extensions(void) {
+	unsigned int	eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 ||
+	    (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+		return false;
+	if (__get_cpuid_max(0, 0) < 7)
+		return false;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	/* CPUID.(EAX=07H, ECX=0):EBX.SHA[bit 29] */
+	return (ebx & (1u << 29)) != 0;
+}
+static bool SHA256_UseX86Extensions(void) {
+	static bool const available = SHA256_HasX86Extensions();
+	return available;
+}
+
+/* Four rounds with the message words in msg, the first round being j: */
+#define ROUND256_X86(msg, j) \
+	MSG = _mm_add_epi32((msg), _mm_loadu_si128((const __m128i*)&K256[(j)])); \
+	STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG); \
+	MSG = _mm_shuffle_epi32(MSG, 0x0E); \
+	STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG)
+/* Message schedule: finish the words in next, start those in prev: */
+#define SCHEDULE256_X86_2(next, prev, cur) \
+	(next) = _mm_sha256msg2_epu32(_mm_add_epi32((next), \
+			_mm_alignr_epi8((cur), (prev), 4)), (cur))
+#define SCHEDULE256_X86_1(prev, cur) \
+	(prev) = _mm_sha256msg1_epu32((prev), (cur))
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void SHA256_Transform_X86(sha2_word32 state[8], const sha2_byte* data, size_t blocks) {
+	__m128i		STATE0, STATE1, MSG, TMP, MSG0, MSG1, MSG2, MSG3;
+	__m128i		ABEF_SAVE, CDGH_SAVE;
+	const __m128i	MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	/* The instructions expect the state as ABEF and CDGH */
+	TMP = _mm_loadu_si128((const __m128i*)&state[0]);
+	STATE1 = _mm_loadu_si128((const __m128i*)&state[4]);
+	TMP = _mm_shuffle_epi32(TMP, 0xB1);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);
+	STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);
+
+	for (; blocks > 0; --blocks, data += SHA256_BLOCK_LENGTH) {
+		ABEF_SAVE = STATE0;
+		CDGH_SAVE = STATE1;
+
+		MSG0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), MASK);
+		MSG1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), MASK);
+		MSG2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), MASK);
+		MSG3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), MASK);
+
+		ROUND256_X86(MSG0, 0);
+		ROUND256_X86(MSG1, 4);
+		SCHEDULE256_X86_1(MSG0, MSG1);
+		ROUND256_X86(MSG2, 8);
+		SCHEDULE256_X86_1(MSG1, MSG2);
+		ROUND256_X86(MSG3, 12);
+		SCHEDULE256_X86_2(MSG0, MSG2, MSG3);
+		SCHEDULE256_X86_1(MSG2, MSG3);
+		ROUND256_X86(MSG0, 16);
+		SCHEDULE256_X86_2(MSG1, MSG3, MSG0);
+		SCHEDULE256_X86_1(MSG3, MSG0);
+		ROUND256_X86(MSG1, 20);
+		SCHEDULE256_X86_2(MSG2, MSG0, MSG1);
+		SCHEDULE256_X86_1(MSG0, MSG1);
+		ROUND256_X86(MSG2, 24);
+		SCHEDULE256_X86_2(MSG3, MSG1, MSG2);
+		SCHEDULE256_X86_1(MSG1, MSG2);
+		ROUND256_X86(MSG3, 28);
+		SCHEDULE256_X86_2(MSG0, MSG2, MSG3);
+		SCHEDULE256_X86_1(MSG2, MSG3);
+		ROUND256_X86(MSG0, 32);
+		SCHEDULE256_X86_2(MSG1, MSG3, MSG0);
+		SCHEDULE256_X86_1(MSG3, MSG0);
+		ROUND256_X86(MSG1, 36);
+		SCHEDULE256_X86_2(MSG2, MSG0, MSG1);
+		SCHEDULE256_X86_1(MSG0, MSG1);
+		ROUND256_X86(MSG2, 40);
+		SCHEDULE256_X86_2(MSG3, MSG1, MSG2);
+		SCHEDULE256_X86_1(MSG1, MSG2);
+		ROUND256_X86(MSG3, 44);
+		SCHEDULE256_X86_2(MSG0, MSG2, MSG3);
+		SCHEDULE256_X86_1(MSG2, MSG3);
+		ROUND256_X86(MSG0, 48);
+		SCHEDULE256_X86_2(MSG1, MSG3, MSG0);
+		SCHEDULE256_X86_1(MSG3, MSG0);
+		ROUND256_X86(MSG1, 52);
+		SCHEDULE256_X86_2(MSG2, MSG0, MSG1);
+		ROUND256_X86(MSG2, 56);
+		SCHEDULE256_X86_2(MSG3, MSG1, MSG2);
+		ROUND256_X86(MSG3, 60);
+
+		STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+		STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+	}
+
+	/* Back from ABEF/CDGH to the usual order */
+	TMP = _mm_shuffle_epi32(STATE0, 0x1B);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);
+	STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);
+	STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+	_mm_storeu_si128((__m128i*)&state[0], STATE0);
+	_mm_storeu_si128((__m128i*)&state[4], STATE1);
+}
+#endif /* SHA2_X86_SHA_EXTENSIONS */
+
+static void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
+#ifdef SHA2_X86_SHA_EXTENSIONS
+	if (SHA256_UseX86Extensions()) {
+		SHA256_Transform_X86(context->state, (const sha2_byte*)data, 1);
+		return;
+	}
+#endif
+	SHA256_Transform_Portable(context, data);
+}
+
 void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 	unsigned int	freespace, usedspace;
 
@@ -560,6 +693,16 @@ void SHA256_Update(SHA256_CTX* context, const sha2_byte *data, size_t len) {
 			return;
 		}
 	}
+#ifdef SHA2_X86_SHA_EXTENSIONS
+	if (len >= SHA256_BLOCK_LENGTH && SHA256_UseX86Extensions()) {
+		/* Process all complete blocks in place */
+		size_t const blocks = len / SHA256_BLOCK_LENGTH;
+		SHA256_Transform_X86(context->state, data, blocks);
+		context->bitcount += (sha2_word64)(blocks * SHA256_BLOCK_LENGTH) << 3;
+		len -= blocks * SHA256_BLOCK_LENGTH;
+		data += blocks * SHA256_BLOCK_LENGTH;
+	}
+#endif
 	while (len >= SHA256_BLOCK_LENGTH) {
 		/* Process as many complete blocks as we can */
 		sha2_byte buffer[SHA256_BLOCK_LENGTH];
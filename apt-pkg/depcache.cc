@@ -34,16 +34,83 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <set>
+#include <thread>
 
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include <apti18n.h>
 									/*}}}*/
 
 using std::string;
 
+class pkgDepCachePrivate						/*{{{*/
+{
+   public:
+   /* The undo log of the snapshots: while a snapshot exists the previous
+      value of a state is recorded the first time it is changed after the
+      latest snapshot. The stamps tell which states were recorded already. */
+   struct Checkpoint
+   {
+      unsigned long Id;
+      size_t PkgLog;
+      size_t DepLog;
+      unsigned long Sweeps;
+      signed long long iUsrSize;
+      unsigned long long iDownloadSize;
+      unsigned long iInstCount;
+      unsigned long iDelCount;
+      unsigned long iKeepCount;
+      unsigned long iBrokenCount;
+      unsigned long iPolicyBrokenCount;
+      unsigned long iBadCount;
+   };
+   std::vector<Checkpoint> Checkpoints;
+   std::vector<std::pair<map_id_t, pkgDepCache::StateCache>> PkgLog;
+   std::vector<std::pair<map_id_t, unsigned char>> DepLog;
+   std::vector<unsigned int> PkgStamp;
+   std::vector<unsigned int> DepStamp;
+   unsigned int Stamp;
+   unsigned long Sweeps;
+   // identifiers are never reused, so stale ones can't match a newer snapshot
+   unsigned long NextSnapshot;
+
+   inline void RecordPkg(pkgDepCache::StateCache const * const PkgState, map_id_t const ID)
+   {
+      if (Checkpoints.empty() == true || PkgStamp[ID] == Stamp)
+	 return;
+      PkgStamp[ID] = Stamp;
+      PkgLog.emplace_back(ID, PkgState[ID]);
+   }
+   inline void RecordDep(unsigned char const * const DepState, map_id_t const ID)
+   {
+      if (Checkpoints.empty() == true || DepStamp[ID] == Stamp)
+	 return;
+      DepStamp[ID] = Stamp;
+      DepLog.emplace_back(ID, DepState[ID]);
+   }
+   std::vector<Checkpoint>::iterator FindCheckpoint(unsigned long const Id)
+   {
+      return std::find_if(Checkpoints.begin(), Checkpoints.end(),
+	    [&](Checkpoint const &C) { return C.Id == Id; });
+   }
+   void NextStamp()
+   {
+      if (++Stamp != 0)
+	 return;
+      std::fill(PkgStamp.begin(), PkgStamp.end(), 0);
+      std::fill(DepStamp.begin(), DepStamp.end(), 0);
+      Stamp = 1;
+   }
+
+   pkgDepCachePrivate() : Stamp(0), Sweeps(0), NextSnapshot(1) {}
+};
+									/*}}}*/
 // helper for Install-Recommends-Sections and Never-MarkAuto-Sections	/*{{{*/
 static bool 
 ConfigValueInSubTree(const char* SubTree, const char *needle)
@@ -99,7 +166,7 @@ pkgDepCache::ActionGroup::~ActionGroup()
 pkgDepCache::pkgDepCache(pkgCache * const pCache,Policy * const Plcy) :
   group_level(0), Cache(pCache), PkgState(0), DepState(0),
    iUsrSize(0), iDownloadSize(0), iInstCount(0), iDelCount(0), iKeepCount(0),
-   iBrokenCount(0), iPolicyBrokenCount(0), iBadCount(0), d(NULL)
+   iBrokenCount(0), iPolicyBrokenCount(0), iBadCount(0), d(new pkgDepCachePrivate())
 {
    DebugMarker = _config->FindB("Debug::pkgDepCache::Marker", false);
    DebugAutoInstall = _config->FindB("Debug::pkgDepCache::AutoInstall", false);
@@ -117,6 +184,7 @@ pkgDepCache::~pkgDepCache()
    delete [] PkgState;
    delete [] DepState;
    delete delLocalPolicy;
+   delete d;
 }
 									/*}}}*/
 // DepCache::Init - Generate the initial extra structures.		/*{{{*/
@@ -128,6 +196,10 @@ bool pkgDepCache::Init(OpProgress * const Prog)
    // run a mark operation when Init terminates.
    ActionGroup actions(*this);
 
+   // the snapshots belong to the old states
+   if (d->Checkpoints.empty() == false)
+      ForgetSnapshot(d->Checkpoints.front().Id);
+
    delete [] PkgState;
    delete [] DepState;
    PkgState = new StateCache[Head().PackageCount];
@@ -492,6 +564,10 @@ void pkgDepCache::AddStates(const PkgIterator &Pkg, bool const Invert)
    signed char const Add = (Invert == false) ? 1 : -1;
    StateCache &State = PkgState[Pkg->ID];
 
+   // the states of a package are only changed after they were removed
+   if (Invert == true)
+      d->RecordPkg(PkgState, Pkg->ID);
+
    // The Package is broken (either minimal dep or policy dep)
    if ((State.DepState & DepInstMin) != DepInstMin)
       iBrokenCount += Add;
@@ -544,6 +620,7 @@ void pkgDepCache::BuildGroupOrs(VerIterator const &V)
    for (DepIterator D = V.DependsList(); D.end() != true; ++D)
    {
       // Build the dependency state.
+      d->RecordDep(DepState, D->ID);
       unsigned char &State = DepState[D->ID];
 
       /* Invert for Conflicts. We have to do this twice to get the
@@ -652,12 +729,88 @@ void pkgDepCache::UpdateVerState(PkgIterator const &Pkg)
    }
 }
 									/*}}}*/
+// DepCache::UpdateDepStates - Compute the dep states of a package	/*{{{*/
+// ---------------------------------------------------------------------
+/* This computes the state of all dependencies of all versions of the
+   package as well as the combined state of the package itself. Only state
+   belonging to this package is written, so it can be called for different
+   packages at the same time. */
+void pkgDepCache::UpdateDepStates(PkgIterator const &Pkg)
+{
+   for (VerIterator V = Pkg.VersionList(); V.end() != true; ++V)
+   {
+      unsigned char Group = 0;
+
+      for (DepIterator D = V.DependsList(); D.end() != true; ++D)
+      {
+	 // Build the dependency state.
+	 unsigned char &State = DepState[D->ID];
+	 State = DependencyState(D);
+
+	 // Add to the group if we are within an or..
+	 Group |= State;
+	 State |= Group << 3;
+	 if ((D->CompareOp & Dep::Or) != Dep::Or)
+	    Group = 0;
+
+	 // Invert for Conflicts
+	 if (D.IsNegative() == true)
+	    State = ~State;
+      }
+   }
+   UpdateVerState(Pkg);
+}
+									/*}}}*/
+// CacheThreads - number of threads to use for the whole cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* Threads call the policy (which frontends can override) concurrently,
+   so they are only used if asked for. 0 picks a number which is worth
+   starting the threads for this cache. */
+static long CacheThreads(unsigned long const PackageCount)
+{
+   long const Threads = _config->FindI("APT::Cache-Threads", 1);
+   if (Threads > 0)
+      return Threads;
+   return PackageCount < 20000 ? 1 : std::min(8u, std::thread::hardware_concurrency());
+}
+									/*}}}*/
+// RunOnThreads - run the worker on the main and some helper threads	/*{{{*/
+// ---------------------------------------------------------------------
+/* The worker has to take its work from a shared queue. If no more threads
+   can be started the ones already running (and the main thread, which
+   gets true as argument) do all the work. */
+static void RunOnThreads(long const Threads, std::function<void(bool)> const &Worker)
+{
+   std::vector<std::thread> Helpers;
+   try
+   {
+      for (long T = 1; T < Threads; ++T)
+	 Helpers.emplace_back(Worker, false);
+   }
+   catch (std::exception const &)
+   {
+      // std::system_error if the thread can't be started
+   }
+   Worker(true);
+   for (auto &H : Helpers)
+      H.join();
+}
+									/*}}}*/
 // DepCache::Update - Figure out all the state information		/*{{{*/
 // ---------------------------------------------------------------------
 /* This will figure out the state of all the packages and all the 
    dependencies based on the current policy. */
 void pkgDepCache::Update(OpProgress * const Prog)
 {   
+   // all states are recomputed, so all of them are recorded for the snapshots
+   if (d->Checkpoints.empty() == false)
+   {
+      for (map_id_t I = 0; I != Head().PackageCount; ++I)
+	 d->RecordPkg(PkgState, I);
+      for (map_id_t I = 0; I != Head().DependsCount; ++I)
+	 d->RecordDep(DepState, I);
+   }
+
    iUsrSize = 0;
    iDownloadSize = 0;
    iInstCount = 0;
@@ -667,38 +820,57 @@ void pkgDepCache::Update(OpProgress * const Prog)
    iPolicyBrokenCount = 0;
    iBadCount = 0;
 
+   /* The dependency states of the packages are independent of each other,
+      so on big caches they are computed by several threads working on
+      chunks of packages if APT::Cache-Threads asks for it. */
+   unsigned long const PackageCount = Head().PackageCount;
+   long const Threads = CacheThreads(PackageCount);
+
    // Perform the depends pass
    int Done = 0;
-   for (PkgIterator I = PkgBegin(); I.end() != true; ++I, ++Done)
+   if (Threads <= 1)
    {
-      if (Prog != 0 && Done%20 == 0)
-	 Prog->Progress(Done);
-      for (VerIterator V = I.VersionList(); V.end() != true; ++V)
+      for (PkgIterator I = PkgBegin(); I.end() != true; ++I, ++Done)
       {
-	 unsigned char Group = 0;
+	 if (Prog != 0 && Done%20 == 0)
+	    Prog->Progress(Done);
+	 UpdateDepStates(I);
 
-	 for (DepIterator D = V.DependsList(); D.end() != true; ++D)
+	 // Compute the package dependency state and size additions
+	 AddSizes(I);
+	 AddStates(I);
+      }
+   }
+   else
+   {
+      std::vector<PkgIterator> Pkgs;
+      Pkgs.reserve(PackageCount);
+      for (PkgIterator I = PkgBegin(); I.end() != true; ++I)
+	 Pkgs.push_back(I);
+
+      size_t const ChunkSize = 256;
+      std::atomic<size_t> NextChunk(0);
+      std::atomic<size_t> ChunksDone(0);
+      // the main thread reports the progress of all
+      RunOnThreads(Threads, [&](bool const Main) {
+	 for (size_t Start = NextChunk++ * ChunkSize; Start < Pkgs.size(); Start = NextChunk++ * ChunkSize)
 	 {
-	    // Build the dependency state.
-	    unsigned char &State = DepState[D->ID];
-	    State = DependencyState(D);
-
-	    // Add to the group if we are within an or..
-	    Group |= State;
-	    State |= Group << 3;
-	    if ((D->CompareOp & Dep::Or) != Dep::Or)
-	       Group = 0;
-
-	    // Invert for Conflicts
-	    if (D.IsNegative() == true)
-	       State = ~State;
+	    if (Main == true && Prog != 0)
+	       Prog->Progress(std::min(ChunksDone.load() * ChunkSize, Pkgs.size()));
+	    size_t const End = std::min(Start + ChunkSize, Pkgs.size());
+	    for (size_t I = Start; I != End; ++I)
+	       UpdateDepStates(Pkgs[I]);
+	    ++ChunksDone;
 	 }
-      }
+      });
 
-      // Compute the package dependency state and size additions
-      AddSizes(I);
-      UpdateVerState(I);
-      AddStates(I);
+      // the counters are cheap to compute, so this stays on one thread
+      for (auto const &I : Pkgs)
+      {
+	 AddSizes(I);
+	 AddStates(I);
+      }
+      Done = Pkgs.size();
    }
 
    if (Prog != 0)
@@ -716,6 +888,7 @@ void pkgDepCache::Update(DepIterator D)
    // Update the reverse deps
    for (;D.end() != true; ++D)
    {      
+      d->RecordDep(DepState, D->ID);
       unsigned char &State = DepState[D->ID];
       State = DependencyState(D);
     
@@ -733,28 +906,67 @@ void pkgDepCache::Update(DepIterator D)
 // DepCache::Update - Update the related deps of a package		/*{{{*/
 // ---------------------------------------------------------------------
 /* This is called whenever the state of a package changes. It updates
-   all cached dependencies related to this package. */
+   all cached dependencies related to this package. The parents of the
+   dependencies are only recomputed if the state of one of them changed and
+   only once even if they are reached via multiple dependencies (e.g. over
+   the package itself and a virtual package it provides). */
 void pkgDepCache::Update(PkgIterator const &Pkg)
 {   
    // Recompute the dep of the package
    RemoveStates(Pkg);
    UpdateVerState(Pkg);
    AddStates(Pkg);
-   
+
+   std::vector<std::pair<map_id_t, Version *>> Parents;
+   auto const UpdateDeps = [&](DepIterator D) {
+      for (; D.end() != true; ++D)
+      {
+	 unsigned char &State = DepState[D->ID];
+	 unsigned char NewState = DependencyState(D);
+
+	 // Invert for Conflicts
+	 if (D.IsNegative() == true)
+	    NewState = ~NewState;
+
+	 // the or-group bits are rebuilt along with the parent
+	 if (((State ^ NewState) & 0x7) == 0)
+	    continue;
+	 d->RecordDep(DepState, D->ID);
+	 State = NewState;
+	 Parents.emplace_back(D.ParentPkg()->ID, D.ParentVer());
+      }
+   };
+
    // Update the reverse deps
-   Update(Pkg.RevDependsList());
+   UpdateDeps(Pkg.RevDependsList());
 
    // Update the provides map for the current ver
    if (Pkg->CurrentVer != 0)
       for (PrvIterator P = Pkg.CurrentVer().ProvidesList(); 
 	   P.end() != true; ++P)
-	 Update(P.ParentPkg().RevDependsList());
+	 UpdateDeps(P.ParentPkg().RevDependsList());
 
    // Update the provides map for the candidate ver
    if (PkgState[Pkg->ID].CandidateVer != 0)
       for (PrvIterator P = PkgState[Pkg->ID].CandidateVerIter(*this).ProvidesList();
 	   P.end() != true; ++P)
-	 Update(P.ParentPkg().RevDependsList());
+	 UpdateDeps(P.ParentPkg().RevDependsList());
+
+   if (Parents.empty() == true)
+      return;
+
+   // Recompute each parent package (and each of its versions) only once
+   std::sort(Parents.begin(), Parents.end());
+   Parents.erase(std::unique(Parents.begin(), Parents.end()), Parents.end());
+   for (auto P = Parents.cbegin(); P != Parents.cend();)
+   {
+      PkgIterator const Parent = VerIterator(*Cache, P->second).ParentPkg();
+      RemoveStates(Parent);
+      for (map_id_t const ID = P->first; P != Parents.cend() && P->first == ID; ++P)
+	 BuildGroupOrs(VerIterator(*Cache, P->second));
+      UpdateVerState(Parent);
+      AddStates(Parent);
+   }
 }
 									/*}}}*/
 // DepCache::MarkKeep - Put the package in the keep state		/*{{{*/
@@ -780,6 +992,7 @@ bool pkgDepCache::MarkKeep(PkgIterator const &Pkg, bool Soft, bool FromUser,
    if (P.Mode == ModeKeep)
       return true;
 
+   d->RecordPkg(PkgState, Pkg->ID);
    if (Soft == true)
       P.iFlags |= AutoKept;
    else
@@ -837,6 +1050,7 @@ bool pkgDepCache::MarkDelete(PkgIterator const &Pkg, bool rPurge,
    if (IsDeleteOk(Pkg,rPurge,Depth,FromUser) == false)
       return false;
 
+   d->RecordPkg(PkgState, Pkg->ID);
    P.iFlags &= ~(AutoKept | Purge);
    if (rPurge == true)
       P.iFlags |= Purge;
@@ -1095,6 +1309,7 @@ bool pkgDepCache::MarkInstall(PkgIterator const &Pkg,bool AutoInst,
    }
 
    // check if we are allowed to install the package
+   d->RecordPkg(PkgState, Pkg->ID);
    if (IsInstallOk(Pkg,AutoInst,Depth,FromUser) == false)
       return false;
 
@@ -1379,6 +1594,7 @@ bool pkgDepCache::IsInstallOkMultiArchSameVersionSynced(PkgIterator const &Pkg,
       if (CV.Downloadable() == false)
 	 continue;
 
+      d->RecordPkg(PkgState, Pkg->ID);
       PkgState[Pkg->ID].iFlags |= AutoKept;
       if (unlikely(DebugMarker == true))
 	 std::clog << OutputInDepth(Depth) << "Ignore MarkInstall of " << APT::PrettyPkg(this, Pkg)
@@ -1687,12 +1903,97 @@ void pkgDepCache::MarkAuto(const PkgIterator &Pkg, bool Auto)
 
   ActionGroup group(*this);
 
+  d->RecordPkg(PkgState, Pkg->ID);
   if(Auto)
     state.Flags |= Flag::Auto;
   else
     state.Flags &= ~Flag::Auto;
 }
 									/*}}}*/
+// DepCache::Snapshot - Start recording the changes of the states	/*{{{*/
+// ---------------------------------------------------------------------
+/* The stamps are only allocated with the first snapshot, so a depcache
+   which is never rolled back does not pay for them. */
+unsigned long pkgDepCache::Snapshot()
+{
+   if (d->PkgStamp.size() != Head().PackageCount)
+   {
+      d->PkgStamp.assign(Head().PackageCount, 0);
+      d->DepStamp.assign(Head().DependsCount, 0);
+   }
+   d->NextStamp();
+
+   pkgDepCachePrivate::Checkpoint C;
+   C.Id = d->NextSnapshot++;
+   C.PkgLog = d->PkgLog.size();
+   C.DepLog = d->DepLog.size();
+   C.Sweeps = d->Sweeps;
+   C.iUsrSize = iUsrSize;
+   C.iDownloadSize = iDownloadSize;
+   C.iInstCount = iInstCount;
+   C.iDelCount = iDelCount;
+   C.iKeepCount = iKeepCount;
+   C.iBrokenCount = iBrokenCount;
+   C.iPolicyBrokenCount = iPolicyBrokenCount;
+   C.iBadCount = iBadCount;
+   d->Checkpoints.push_back(C);
+   return C.Id;
+}
+									/*}}}*/
+// DepCache::Rollback - Undo the changes made since a snapshot		/*{{{*/
+// ---------------------------------------------------------------------
+/* The log is replayed backwards, so a state recorded more than once ends
+   up with its oldest value. */
+bool pkgDepCache::Rollback(unsigned long const Id)
+{
+   auto const Found = d->FindCheckpoint(Id);
+   if (unlikely(Found == d->Checkpoints.end()))
+      return _error->Error("Can't roll back to the unknown snapshot %lu", Id);
+
+   pkgDepCachePrivate::Checkpoint const C = *Found;
+   for (auto L = d->PkgLog.size(); L != C.PkgLog; --L)
+      PkgState[d->PkgLog[L - 1].first] = d->PkgLog[L - 1].second;
+   for (auto L = d->DepLog.size(); L != C.DepLog; --L)
+      DepState[d->DepLog[L - 1].first] = d->DepLog[L - 1].second;
+   d->PkgLog.resize(C.PkgLog);
+   d->DepLog.resize(C.DepLog);
+   d->Checkpoints.erase(Found + 1, d->Checkpoints.end());
+   // the states have to be recorded again for further changes
+   d->NextStamp();
+
+   iUsrSize = C.iUsrSize;
+   iDownloadSize = C.iDownloadSize;
+   iInstCount = C.iInstCount;
+   iDelCount = C.iDelCount;
+   iKeepCount = C.iKeepCount;
+   iBrokenCount = C.iBrokenCount;
+   iPolicyBrokenCount = C.iPolicyBrokenCount;
+   iBadCount = C.iBadCount;
+
+   // the marks of the automatic removal are not recorded, but recalculated
+   if (C.Sweeps != d->Sweeps)
+   {
+      bool const Ret = MarkAndSweep();
+      d->Checkpoints.back().Sweeps = d->Sweeps;
+      return Ret;
+   }
+   return true;
+}
+									/*}}}*/
+// DepCache::ForgetSnapshot - Keep the changes made since a snapshot	/*{{{*/
+void pkgDepCache::ForgetSnapshot(unsigned long const Id)
+{
+   auto const Found = d->FindCheckpoint(Id);
+   if (Found == d->Checkpoints.end())
+      return;
+   d->Checkpoints.erase(Found, d->Checkpoints.end());
+   if (d->Checkpoints.empty() == true)
+   {
+      d->PkgLog.clear();
+      d->DepLog.clear();
+   }
+}
+									/*}}}*/
 // StateCache::Update - Compute the various static display things	/*{{{*/
 // ---------------------------------------------------------------------
 /* This is called whenever the Candidate version changes. */
@@ -1846,6 +2147,7 @@ bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
       return true;
 
    bool const debug_autoremove = _config->FindB("Debug::pkgAutoRemove",false);
+   ++d->Sweeps;
 
    // init the states
    auto const PackagesCount = Head().PackageCount;
@@ -1862,10 +2164,32 @@ bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
    bool const follow_recommends = MarkFollowsRecommends();
    bool const follow_suggests   = MarkFollowsSuggests();
 
-   // do the mark part, this is the core bit of the algorithm
+   struct timeval Start;
+   gettimeofday(&Start, NULL);
+
+   /* The mark part, this is the core bit of the algorithm: starting with
+      the root set the packages kept by the marked packages are marked level
+      by level. The marks are kept in a bitset which is only read while the
+      dependencies of a level are followed, so big levels can be split over
+      several threads. The next level is built in the order of the current
+      one, so the result does not depend on the number of threads. Providers
+      are followed even for packages marked already, so it doesn't depend
+      on the IDs of the packages either. */
+   std::vector<bool> Marked(PackagesCount, false);
+   std::vector<VerIterator> Level;
+   auto const MarkVersion = [&](PkgIterator const &P, VerIterator const &V) {
+      if (Marked[P->ID] || unlikely(V.end()))
+	 return;
+      Marked[P->ID] = true;
+      if (IsPkgInBoringState(P, PkgState))
+	 return;
+      if (debug_autoremove)
+	 std::clog << "Marking: " << P.FullName() << " " << V.VerStr() << std::endl;
+      Level.push_back(V);
+   };
    for (PkgIterator P = PkgBegin(); !P.end(); ++P)
    {
-      if (PkgState[P->ID].Marked || IsPkgInBoringState(P, PkgState))
+      if (Marked[P->ID] || IsPkgInBoringState(P, PkgState))
 	 continue;
 
       if ((PkgState[P->ID].Flags & Flag::Auto) == 0)
@@ -1885,50 +2209,79 @@ bool pkgDepCache::MarkRequired(InRootSetFunc &userFunc)
 	 continue;
 
       if (PkgState[P->ID].Install())
-	 MarkPackage(P, PkgState[P->ID].InstVerIter(*this),
-	       follow_recommends, follow_suggests);
+	 MarkVersion(P, PkgState[P->ID].InstVerIter(*this));
       else
-	 MarkPackage(P, P.CurrentVer(),
-	       follow_recommends, follow_suggests);
+	 MarkVersion(P, P.CurrentVer());
    }
 
-   return true;
-}
-									/*}}}*/
-// MarkPackage - mark a single package in Mark-and-Sweep		/*{{{*/
-void pkgDepCache::MarkPackage(const pkgCache::PkgIterator &Pkg,
-			      const pkgCache::VerIterator &Ver,
-			      bool const &follow_recommends,
-			      bool const &follow_suggests)
-{
+   // the debug output of the threads would be interleaved
+   long const Threads = debug_autoremove ? 1 : CacheThreads(PackagesCount);
+   size_t const ChunkSize = 256;
+
+   unsigned long Levels = 0;
+   std::vector<std::vector<VerIterator>> Kept;
+   while (Level.empty() == false)
    {
-      pkgDepCache::StateCache &state = PkgState[Pkg->ID];
-      // if we are marked already we are done
-      if(state.Marked || unlikely(Ver.end()))
-	 return;
-      state.Marked=true;
+      ++Levels;
+      std::vector<VerIterator> Current;
+      std::swap(Current, Level);
+      Kept.clear();
+      Kept.resize((Current.size() + ChunkSize - 1) / ChunkSize);
+
+      std::atomic<size_t> NextChunk(0);
+      RunOnThreads(std::min<size_t>(Threads, Kept.size()), [&](bool) {
+	 for (size_t Chunk = NextChunk++; Chunk < Kept.size(); Chunk = NextChunk++)
+	 {
+	    size_t const End = std::min((Chunk + 1) * ChunkSize, Current.size());
+	    for (size_t I = Chunk * ChunkSize; I != End; ++I)
+	       MarkPackage(Current[I], follow_recommends, follow_suggests, Marked, Kept[Chunk]);
+	 }
+      });
+
+      for (auto const &Chunk : Kept)
+	 for (auto const &V : Chunk)
+	    MarkVersion(V.ParentPkg(), V);
    }
 
-   if (IsPkgInBoringState(Pkg, PkgState))
-      return;
+   unsigned long MarkedCount = 0;
+   for (auto i = decltype(PackagesCount){0}; i < PackagesCount; ++i)
+      if (Marked[i])
+      {
+	 PkgState[i].Marked = true;
+	 ++MarkedCount;
+      }
 
+   if (debug_autoremove)
+   {
+      struct timeval Stop;
+      gettimeofday(&Stop, NULL);
+      double const Took = Stop.tv_sec - Start.tv_sec + (Stop.tv_usec - Start.tv_usec) / 1000000.0;
+      ioprintf(std::clog, "Marked %lu packages in %lu levels in %.3fs\n", MarkedCount, Levels, Took);
+   }
+   return true;
+}
+									/*}}}*/
+// MarkPackage - collect the versions kept by a marked version		/*{{{*/
+void pkgDepCache::MarkPackage(const pkgCache::VerIterator &Ver,
+			      bool const follow_recommends,
+			      bool const follow_suggests,
+			      std::vector<bool> const &Marked,
+			      std::vector<pkgCache::VerIterator> &Kept)
+{
    bool const debug_autoremove = _config->FindB("Debug::pkgAutoRemove", false);
-   if(debug_autoremove)
-      std::clog << "Marking: " << Pkg.FullName() << " " << Ver.VerStr() << std::endl;
 
    for (auto D = Ver.DependsList(); D.end() == false; ++D)
    {
       auto const T = D.TargetPkg();
-      if (PkgState[T->ID].Marked)
-	 continue;
-
       if (D->Type != Dep::Depends &&
 	    D->Type != Dep::PreDepends &&
 	    (follow_recommends == false || D->Type != Dep::Recommends) &&
 	    (follow_suggests == false || D->Type != Dep::Suggests))
 	 continue;
 
-      // handle the virtual part first
+      /* handle the virtual part first: the providers are kept even if the
+	 package itself is marked already, as it depends on the order the
+	 packages are visited in if that happened before or after this */
       APT::VersionVector providers;
       for(auto Prv = T.ProvidesList(); Prv.end() == false; ++Prv)
       {
@@ -1966,17 +2319,16 @@ void pkgDepCache::MarkPackage(const pkgCache::PkgIterator &Pkg,
 	    }), providers.end());
 	 for (auto && PV: providers)
 	 {
-	    auto const PP = PV.ParentPkg();
 	    if (debug_autoremove)
 	       std::clog << "Following dep: " << APT::PrettyDep(this, D)
-		  << ", provided by " << PP.FullName() << " " << PV.VerStr()
+		  << ", provided by " << PV.ParentPkg().FullName() << " " << PV.VerStr()
 		  << " (" << providers.size() << "/" << prvsize << ")"<< std::endl;
-	    MarkPackage(PP, PV, follow_recommends, follow_suggests);
+	    Kept.push_back(PV);
 	 }
       }
 
       // now deal with the real part of the package
-      if (IsPkgInBoringState(T, PkgState))
+      if (Marked[T->ID] || IsPkgInBoringState(T, PkgState))
 	 continue;
 
       auto const TV = (PkgState[T->ID].Install()) ?
@@ -1986,33 +2338,48 @@ void pkgDepCache::MarkPackage(const pkgCache::PkgIterator &Pkg,
 
       if (debug_autoremove)
 	 std::clog << "Following dep: " << APT::PrettyDep(this, D) << std::endl;
-      MarkPackage(T, TV, follow_recommends, follow_suggests);
+      Kept.push_back(TV);
    }
 }
 									/*}}}*/
 bool pkgDepCache::Sweep()						/*{{{*/
 {
    bool debug_autoremove = _config->FindB("Debug::pkgAutoRemove",false);
+   struct timeval Start;
+   gettimeofday(&Start, NULL);
 
    // do the sweep
+   unsigned long GarbageCount = 0;
    for(PkgIterator p=PkgBegin(); !p.end(); ++p)
    {
      StateCache &state=PkgState[p->ID];
 
+     // most packages are marked, so check that before looking at the cache
+     if (state.Marked)
+	continue;
+
      // skip required packages
      if (!p.CurrentVer().end() && 
 	 (p.CurrentVer()->Priority == pkgCache::State::Required))
 	continue;
 
      // if it is not marked and it is installed, it's garbage 
-     if(!state.Marked && (!p.CurrentVer().end() || state.Install()))
+     if(!p.CurrentVer().end() || state.Install())
      {
 	state.Garbage=true;
+	++GarbageCount;
 	if(debug_autoremove)
 	   std::clog << "Garbage: " << p.FullName() << std::endl;
      }
   }   
 
+   if (debug_autoremove)
+   {
+      struct timeval Stop;
+      gettimeofday(&Stop, NULL);
+      double const Took = Stop.tv_sec - Start.tv_sec + (Stop.tv_usec - Start.tv_usec) / 1000000.0;
+      ioprintf(std::clog, "Found %lu garbage packages in %.3fs\n", GarbageCount, Took);
+   }
    return true;
 }
 									/*}}}*/
@@ -48,6 +48,7 @@
 #include <list>
 #include <string>
 #include <utility>
+#include <vector>
 
 #ifndef APT_8_CLEANER_HEADERS
 #include <apt-pkg/progress.h>
@@ -55,11 +56,11 @@
 #endif
 #ifndef APT_10_CLEANER_HEADERS
 #include <set>
-#include <vector>
 #endif
 
 class OpProgress;
 class pkgVersioningSystem;
+class pkgDepCachePrivate;
 
 class pkgDepCache : protected pkgCache::Namespace
 {
@@ -74,26 +75,30 @@ class pkgDepCache : protected pkgCache::Namespace
    };
 
    private:
-   /** \brief Mark a single package and all its unmarked important
-    *  dependencies during mark-and-sweep.
-    *
-    *  Recursively invokes itself to mark all dependencies of the
-    *  package.
+   /** \brief Collect the versions kept by a marked version during
+    *  mark-and-sweep.
     *
-    *  \param pkg The package to mark.
+    *  Only reads the marks, so it can be called for several versions
+    *  of the same level at the same time.
     *
-    *  \param ver The version of the package that is to be marked.
+    *  \param ver The version of the package that was marked.
     *
     *  \param follow_recommends If \b true, recommendations of the
-    *  package will be recursively marked.
+    *  package keep their targets, too.
     *
     *  \param follow_suggests If \b true, suggestions of the package
-    *  will be recursively marked.
+    *  keep their targets, too.
+    *
+    *  \param marked The packages marked in the previous levels.
+    *
+    *  \param kept The versions to be marked in the next level are
+    *  appended to this list.
     */
-   APT_HIDDEN void MarkPackage(const pkgCache::PkgIterator &pkg,
-		    const pkgCache::VerIterator &ver,
-		    bool const &follow_recommends,
-		    bool const &follow_suggests);
+   APT_HIDDEN void MarkPackage(const pkgCache::VerIterator &ver,
+		    bool const follow_recommends,
+		    bool const follow_suggests,
+		    std::vector<bool> const &marked,
+		    std::vector<pkgCache::VerIterator> &kept);
 
    /** \brief Update the Marked field of all packages.
     *
@@ -338,6 +343,7 @@ class pkgDepCache : protected pkgCache::Namespace
 			      unsigned char const SetPolicy) const;
 
    // Recalculates various portions of the cache, call after changing something
+   APT_HIDDEN void UpdateDepStates(PkgIterator const &Pkg);
    void Update(DepIterator Dep);           // Mostly internal
    void Update(PkgIterator const &P);
    
@@ -450,6 +456,44 @@ class pkgDepCache : protected pkgCache::Namespace
    void MarkAuto(const PkgIterator &Pkg, bool Auto);
    // @}
 
+   /** \name Snapshots
+    *
+    *  A snapshot allows to try out changes with the state manipulators
+    *  and to undo them afterwards, e.g. to compare the installation of
+    *  one package with the installation of another. While a snapshot
+    *  exists the previous value of each state is recorded the first
+    *  time it is changed, so rolling back costs only as much as the
+    *  changes made since the snapshot.
+    *
+    *  Snapshots should be taken within an ActionGroup, so that the
+    *  automatic removal calculation does not run in between. If it
+    *  does, it is run again on rollback. They are not bound to action
+    *  groups though: groups are used everywhere and can't fail when
+    *  they end, while recording is only paid for by callers which
+    *  want to roll back. The flag set by #MarkProtected is not recorded.
+    */
+   // @{
+   /** \brief Start recording the changes of the states.
+    *
+    *  \return an identifier for the snapshot. Snapshots can be nested.
+    *  Identifiers are not reused, so rolling back to a forgotten
+    *  snapshot fails instead of picking another one.
+    */
+   unsigned long Snapshot();
+   /** \brief Undo all changes made since the snapshot was taken.
+    *
+    *  The snapshot stays, so further changes can be undone again; all
+    *  snapshots taken after it are forgotten.
+    */
+   bool Rollback(unsigned long const Id);
+   /** \brief Keep the changes and forget the snapshot (and all snapshots
+    *  taken after it).
+    *
+    *  Once no snapshot is left, the changes are no longer recorded.
+    */
+   void ForgetSnapshot(unsigned long const Id);
+   // @}
+
    /** \return \b true if it's OK for MarkInstall to install
     *  the given package.
     *
@@ -516,7 +560,7 @@ class pkgDepCache : protected pkgCache::Namespace
 	 bool const rPurge, unsigned long const Depth, bool const FromUser);
 
    private:
-   void * const d;
+   pkgDepCachePrivate * const d;
 
    APT_HIDDEN bool IsModeChangeOk(ModeList const mode, PkgIterator const &Pkg,
 			unsigned long const Depth, bool const FromUser);
@@ -27,25 +27,46 @@
 #include <apt-pkg/versionmatch.h>
 #include <apt-pkg/version.h>
 
+#include <algorithm>
 #include <ctype.h>
 #include <stddef.h>
 #include <string.h>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <typeinfo>
 
 #include <apti18n.h>
 									/*}}}*/
 
 using namespace std;
 
+class pkgPolicyPrivate
+{
+   public:
+   /* The candidate of each package is remembered once it was calculated
+      until the pins or the priorities of the files change. Derived classes
+      can change those directly, so only pkgPolicy itself uses this. */
+   std::vector<map_pointer_t> Candidates;
+   std::vector<bool> Known;
+
+   void Forget(map_id_t const ID) { Known[ID] = false; }
+   void ForgetAll() { std::fill(Known.begin(), Known.end(), false); }
+
+   explicit pkgPolicyPrivate(unsigned long const PackageCount) :
+      Candidates(PackageCount, 0), Known(PackageCount, false) {}
+};
+
 // Policy::Init - Startup and bind to a cache				/*{{{*/
 // ---------------------------------------------------------------------
 /* Set the defaults for operation. The default mode with no loaded policy
    file matches the V0 policy engine. */
 pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(nullptr), VerPins(nullptr),
-   PFPriority(nullptr), Cache(Owner), d(NULL)
+   PFPriority(nullptr), Cache(Owner),
+   d(new pkgPolicyPrivate(Owner == nullptr ? 0 : Owner->Head().PackageCount))
 {
    if (Owner == 0)
       return;
@@ -86,6 +107,8 @@ pkgPolicy::pkgPolicy(pkgCache *Owner) : Pins(nullptr), VerPins(nullptr),
 /* */
 bool pkgPolicy::InitDefaults()
 {   
+   d->ForgetAll();
+
    // Initialize the priorities based on the status of the package file
    for (pkgCache::PkgFileIterator I = Cache->FileBegin(); I != Cache->FileEnd(); ++I)
    {
@@ -129,29 +152,48 @@ bool pkgPolicy::InitDefaults()
 // Policy::GetCandidateVer - Get the candidate install version		/*{{{*/
 // ---------------------------------------------------------------------
 /* Evaluate the package pins and the default list to deteremine what the
-   best package is. */
+   best package is. The versions of a package are sorted, so the versions
+   older than the current one are those behind it in the list and only
+   the first of them needs to be compared to know that. */
 pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator const &Pkg)
 {
+   bool const Cached = typeid(*this) == typeid(pkgPolicy);
+   if (Cached == true && d->Known[Pkg->ID] == true)
+      return pkgCache::VerIterator(*Cache, Cache->VerP + d->Candidates[Pkg->ID]);
+
    pkgCache::VerIterator cand;
    pkgCache::VerIterator cur = Pkg.CurrentVer();
    int candPriority = -1;
    pkgVersioningSystem *vs = Cache->VS;
+   bool afterCur = false;
+   bool older = false;
 
    for (pkgCache::VerIterator ver = Pkg.VersionList(); ver.end() == false; ++ver) {
+      if (ver == cur)
+	 afterCur = true;
+
       int priority = GetPriority(ver, true);
 
       if (priority == 0 || priority <= candPriority)
 	 continue;
 
-      // TODO: Maybe optimize to not compare versions
-      if (!cur.end() && priority < 1000
-	  && (vs->CmpVersion(ver.VerStr(), cur.VerStr()) < 0))
-	 continue;
+      if (!cur.end() && priority < 1000 && afterCur == true)
+      {
+	 if (older == false)
+	    older = vs->CmpVersion(ver.VerStr(), cur.VerStr()) < 0;
+	 if (older == true)
+	    continue;
+      }
 
       candPriority = priority;
       cand = ver;
    }
 
+   if (Cached == true)
+   {
+      d->Candidates[Pkg->ID] = cand.end() ? 0 : cand.Index();
+      d->Known[Pkg->ID] = true;
+   }
    return cand;
 }
 									/*}}}*/
@@ -164,85 +206,161 @@ pkgCache::VerIterator pkgPolicy::GetCandidateVer(pkgCache::PkgIterator const &Pk
 void pkgPolicy::CreatePin(pkgVersionMatch::MatchType Type,string Name,
 			  string Data,signed short Priority)
 {
-   if (Name.empty() == true)
+   std::vector<PkgPin> NewPins(1, PkgPin(Name));
+   NewPins[0].Type = Type;
+   NewPins[0].Data = Data;
+   NewPins[0].Priority = Priority;
+   CreatePins(NewPins);
+}
+									/*}}}*/
+// Policy::CreatePins - Create the entries for a list of pins		/*{{{*/
+// ---------------------------------------------------------------------
+/* The result is the same as calling CreatePin for each pin in order, but
+   the wildcard pins are compiled once and matched against the groups in a
+   single pass and the release and origin pins are checked against each
+   package file only once. */
+void pkgPolicy::CreatePins(std::vector<PkgPin> const &NewPins)
+{
+   struct PinRequest
    {
-      Pin *P = &*Defaults.insert(Defaults.end(),Pin());
-      P->Type = Type;
-      P->Priority = Priority;
-      P->Data = Data;
-      return;
-   }
+      PkgPin const &Pin;
+      std::string Name;
+      std::string Arch;
+      std::unique_ptr<APT::CacheFilter::PackageMatcher> Wildcard;
+      std::vector<pkgCache::GrpIterator> Groups;
+      std::vector<bool> const *Files;
+      std::unique_ptr<pkgVersionMatch> Match;
+      std::unique_ptr<APT::CacheFilter::PackageArchitectureMatchesSpecification> ArchMatch;
+      explicit PinRequest(PkgPin const &Pin) : Pin(Pin), Files(nullptr) {}
+   };
+   std::vector<PinRequest> Requests;
+   Requests.reserve(NewPins.size());
+   std::map<std::pair<pkgVersionMatch::MatchType, std::string>, std::vector<bool>> FileMatches;
+   bool HaveWildcards = false;
+
+   for (auto const &P : NewPins)
+   {
+      if (P.Pkg.empty() == true)
+      {
+	 d->ForgetAll();
+	 Pin *D = &*Defaults.insert(Defaults.end(),Pin());
+	 D->Type = P.Type;
+	 D->Priority = P.Priority;
+	 D->Data = P.Data;
+	 continue;
+      }
 
-   size_t found = Name.rfind(':');
-   string Arch;
-   if (found != string::npos) {
-      Arch = Name.substr(found+1);
-      Name.erase(found);
-   }
+      Requests.emplace_back(P);
+      auto &R = Requests.back();
+      R.Name = P.Pkg;
+      size_t found = R.Name.rfind(':');
+      if (found != string::npos) {
+	 R.Arch = R.Name.substr(found+1);
+	 R.Name.erase(found);
+      }
 
-   // Allow pinning by wildcards - beware of package names looking like wildcards!
-   // TODO: Maybe we should always prefer specific pins over non-specific ones.
-   if ((Name[0] == '/' && Name[Name.length() - 1] == '/') || Name.find_first_of("*[?") != string::npos)
-   {
-      pkgVersionMatch match(Data, Type);
-      for (pkgCache::GrpIterator G = Cache->GrpBegin(); G.end() != true; ++G)
-	 if (Name != G.Name() && match.ExpressionMatches(Name, G.Name()))
+      // Allow pinning by wildcards - beware of package names looking like wildcards!
+      // TODO: Maybe we should always prefer specific pins over non-specific ones.
+      if (R.Name.empty() == false && R.Name[0] == '/' && R.Name[R.Name.length() - 1] == '/')
+      {
+	 std::string const Regex = R.Name.length() > 1 ? R.Name.substr(1, R.Name.length() - 2) : "";
+	 _error->PushToStack();
+	 R.Wildcard.reset(new APT::CacheFilter::PackageNameMatchesRegEx(Regex));
+	 if (_error->PendingError() == true)
 	 {
-	    if (Arch.empty() == false)
-	       CreatePin(Type, string(G.Name()).append(":").append(Arch), Data, Priority);
-	    else
-	       CreatePin(Type, G.Name(), Data, Priority);
+	    _error->RevertToStack();
+	    _error->Warning("Invalid regular expression: %s", Regex.c_str());
 	 }
-      return;
+	 else
+	    _error->MergeWithStack();
+	 HaveWildcards = true;
+      }
+      else if (R.Name.find_first_of("*[?") != string::npos)
+      {
+	 R.Wildcard.reset(new APT::CacheFilter::PackageNameMatchesFnmatch(R.Name));
+	 HaveWildcards = true;
+      }
+
+      R.ArchMatch.reset(new APT::CacheFilter::PackageArchitectureMatchesSpecification(
+	       R.Arch.empty() ? Cache->NativeArch() : R.Arch));
+      R.Match.reset(new pkgVersionMatch(P.Data, P.Type));
+      if (P.Type != pkgVersionMatch::Version)
+      {
+	 auto const Key = std::make_pair(P.Type, P.Data);
+	 auto Files = FileMatches.find(Key);
+	 if (Files == FileMatches.end())
+	 {
+	    std::vector<bool> Matches(Cache->Head().PackageFileCount, false);
+	    for (pkgCache::PkgFileIterator F = Cache->FileBegin(); F != Cache->FileEnd(); ++F)
+	       Matches[F->ID] = R.Match->FileMatch(F);
+	    Files = FileMatches.emplace(Key, std::move(Matches)).first;
+	 }
+	 R.Files = &Files->second;
+      }
    }
 
-   // find the package (group) this pin applies to
-   pkgCache::GrpIterator Grp = Cache->FindGrp(Name);
-   bool matched = false;
-   if (Grp.end() == false)
-   {
-      std::string MatchingArch;
-      if (Arch.empty() == true)
-	 MatchingArch = Cache->NativeArch();
-      else
-	 MatchingArch = Arch;
-      APT::CacheFilter::PackageArchitectureMatchesSpecification pams(MatchingArch);
-      for (pkgCache::PkgIterator Pkg = Grp.PackageList(); Pkg.end() != true; Pkg = Grp.NextPkg(Pkg))
+   if (HaveWildcards == true)
+      for (pkgCache::GrpIterator G = Cache->GrpBegin(); G.end() != true; ++G)
+	 for (auto &R : Requests)
+	    if (R.Wildcard != nullptr && R.Name != G.Name() && (*R.Wildcard)(G) == true)
+	       R.Groups.push_back(G);
+
+   auto const CreatePkgPin = [&](PinRequest const &R, pkgCache::GrpIterator const &Grp, std::string const &Name) {
+      // find the package (group) this pin applies to
+      bool matched = false;
+      if (Grp.end() == false)
       {
-	 if (pams(Pkg.Arch()) == false)
-	    continue;
-	 Pin *P = Pins + Pkg->ID;
-	 // the first specific stanza for a package is the ruler,
-	 // all others need to be ignored
-	 if (P->Type != pkgVersionMatch::None)
-	    P = &*Unmatched.insert(Unmatched.end(),PkgPin(Pkg.FullName()));
-	 P->Type = Type;
-	 P->Priority = Priority;
-	 P->Data = Data;
-	 matched = true;
-
-	 // Find matching version(s) and copy the pin into it
-	 pkgVersionMatch Match(P->Data,P->Type);
-	 for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() != true; ++Ver)
+	 for (pkgCache::PkgIterator Pkg = Grp.PackageList(); Pkg.end() != true; Pkg = Grp.NextPkg(Pkg))
 	 {
-	    if (Match.VersionMatches(Ver)) {
-	       Pin *VP = VerPins + Ver->ID;
-	       if (VP->Type == pkgVersionMatch::None)
-		  *VP = *P;
+	    if ((*R.ArchMatch)(Pkg.Arch()) == false)
+	       continue;
+	    Pin *P = Pins + Pkg->ID;
+	    // the first specific stanza for a package is the ruler,
+	    // all others need to be ignored
+	    if (P->Type != pkgVersionMatch::None)
+	       P = &*Unmatched.insert(Unmatched.end(),PkgPin(Pkg.FullName()));
+	    P->Type = R.Pin.Type;
+	    P->Priority = R.Pin.Priority;
+	    P->Data = R.Pin.Data;
+	    matched = true;
+	    d->Forget(Pkg->ID);
+
+	    // Find matching version(s) and copy the pin into it
+	    for (pkgCache::VerIterator Ver = Pkg.VersionList(); Ver.end() != true; ++Ver)
+	    {
+	       bool VerMatches = false;
+	       if (R.Files == nullptr)
+		  VerMatches = R.Match->VersionMatches(Ver);
+	       else
+		  for (pkgCache::VerFileIterator VF = Ver.FileList(); VF.end() == false && VerMatches == false; ++VF)
+		     VerMatches = (*R.Files)[VF.File()->ID];
+	       if (VerMatches) {
+		  Pin *VP = VerPins + Ver->ID;
+		  if (VP->Type == pkgVersionMatch::None)
+		     *VP = *P;
+	       }
 	    }
 	 }
       }
-   }
 
-   if (matched == false)
+      if (matched == false)
+      {
+	 PkgPin *P = &*Unmatched.insert(Unmatched.end(),PkgPin(Name));
+	 if (R.Arch.empty() == false)
+	    P->Pkg.append(":").append(R.Arch);
+	 P->Type = R.Pin.Type;
+	 P->Priority = R.Pin.Priority;
+	 P->Data = R.Pin.Data;
+      }
+   };
+
+   for (auto const &R : Requests)
    {
-      PkgPin *P = &*Unmatched.insert(Unmatched.end(),PkgPin(Name));
-      if (Arch.empty() == false)
-	 P->Pkg.append(":").append(Arch);
-      P->Type = Type;
-      P->Priority = Priority;
-      P->Data = Data;
-      return;
+      if (R.Wildcard == nullptr)
+	 CreatePkgPin(R, Cache->FindGrp(R.Name), R.Name);
+      else
+	 for (auto const &G : R.Groups)
+	    CreatePkgPin(R, G, G.Name());
    }
 }
 									/*}}}*/
@@ -348,6 +466,8 @@ bool ReadPinFile(pkgPolicy &Plcy,string File)
    if (Fd.IsOpen() == false || Fd.Failed())
       return false;
 
+   // the pins are collected so that they can be matched all at once
+   std::vector<pkgPolicy::PkgPin> NewPins;
    pkgTagSection Tags;
    while (TF.Step(Tags) == true)
    {
@@ -406,13 +526,17 @@ bool ReadPinFile(pkgPolicy &Plcy,string File)
       while(!s.eof())
       {
 	 s >> pkg;
-         Plcy.CreatePin(Type, pkg, string(Word,End),priority);
+	 NewPins.emplace_back(pkg);
+	 NewPins.back().Type = Type;
+	 NewPins.back().Data = string(Word,End);
+	 NewPins.back().Priority = priority;
       };
    }
 
+   Plcy.CreatePins(NewPins);
    Plcy.InitDefaults();
    return true;
 }
 									/*}}}*/
 
-pkgPolicy::~pkgPolicy() {delete [] PFPriority; delete [] Pins; delete [] VerPins; }
+pkgPolicy::~pkgPolicy() {delete [] PFPriority; delete [] Pins; delete [] VerPins; delete d; }
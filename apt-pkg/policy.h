@@ -44,6 +44,8 @@
 using std::vector;
 #endif
 
+class pkgPolicyPrivate;
+
 class pkgPolicy : public pkgDepCache::Policy
 {
    protected:
@@ -62,6 +64,9 @@ class pkgPolicy : public pkgDepCache::Policy
       explicit PkgPin(std::string const &Pkg) : Pin(), Pkg(Pkg) {};
    };
    
+   /* pkgPolicy remembers the candidates it calculated and forgets them if
+      the pins change via CreatePin or InitDefaults. Derived classes are free
+      to change these directly as they don't get this cache. */
    Pin *Pins;
    Pin *VerPins;
    signed short *PFPriority;
@@ -88,7 +93,10 @@ class pkgPolicy : public pkgDepCache::Policy
    explicit pkgPolicy(pkgCache *Owner);
    virtual ~pkgPolicy();
    private:
-   void * const d;
+   pkgPolicyPrivate * const d;
+
+   APT_HIDDEN void CreatePins(std::vector<PkgPin> const &NewPins);
+   friend bool ReadPinFile(pkgPolicy &Plcy, std::string File);
 };
 
 bool ReadPinFile(pkgPolicy &Plcy, std::string File = "");
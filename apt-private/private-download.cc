@@ -17,6 +17,7 @@
 #include <apt-private/private-utils.h>
 #include <apt-private/acqprogress.h>
 
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -35,7 +36,10 @@
 #endif
 #include <sys/statvfs.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <errno.h>
+#include <string.h>
+#include <time.h>
 
 #include <apti18n.h>
 									/*}}}*/
@@ -300,6 +304,80 @@ bool DoChangelog(CommandLine &CmdL)
 }
 									/*}}}*/
 
+// CleanSharedArchives - Evict archives from the shared store		/*{{{*/
+// ---------------------------------------------------------------------
+/* The store in Dir::Cache::SharedArchives is used by other systems as well,
+   so rather than removing everything the least recently used archives are
+   removed until it is smaller than APT::Archives::Shared::MaxSize (in MiB)
+   and archives not used for APT::Archives::Shared::MaxAge days are gone. */
+static bool CleanSharedArchives()
+{
+   if (_config->Find("Dir::Cache::SharedArchives").empty() == true ||
+	 _config->FindB("APT::Get::Simulate") == true)
+      return true;
+   std::string const shareddir = _config->FindDir("Dir::Cache::SharedArchives");
+   if (DirectoryExists(shareddir) == false)
+      return true;
+
+   FileFd Lock;
+   if (_config->FindB("Debug::NoLocking",false) == false)
+   {
+      int lock_fd = GetLock(flCombine(shareddir, "lock"));
+      if (lock_fd < 0)
+	 return _error->Error(_("Unable to lock directory %s"), shareddir.c_str());
+      Lock.Fd(lock_fd);
+   }
+
+   DIR *D = opendir(shareddir.c_str());
+   if (D == nullptr)
+      return _error->Errno("opendir", _("Unable to read %s"), shareddir.c_str());
+
+   struct SharedArchive
+   {
+      std::string File;
+      time_t LastUsed;
+      unsigned long long Size;
+   };
+   std::vector<SharedArchive> Archives;
+   unsigned long long TotalSize = 0;
+   time_t const Now = time(nullptr);
+   for (struct dirent *Ent = readdir(D); Ent != nullptr; Ent = readdir(D))
+   {
+      if (strcmp(Ent->d_name, ".") == 0 || strcmp(Ent->d_name, "..") == 0 ||
+	    strcmp(Ent->d_name, "lock") == 0)
+	 continue;
+      std::string const File = flCombine(shareddir, Ent->d_name);
+      struct stat St;
+      if (lstat(File.c_str(), &St) != 0 || S_ISREG(St.st_mode) == false)
+	 continue;
+      // leftovers of interrupted copies into the store
+      if (strchr(Ent->d_name, '.') != nullptr)
+      {
+	 if (Now - St.st_mtime > 24 * 60 * 60)
+	    RemoveFile("CleanSharedArchives", File);
+	 continue;
+      }
+      Archives.push_back({File, St.st_atime, static_cast<unsigned long long>(St.st_size)});
+      TotalSize += St.st_size;
+   }
+   closedir(D);
+
+   std::sort(Archives.begin(), Archives.end(), [](SharedArchive const &A, SharedArchive const &B) {
+      return A.LastUsed < B.LastUsed;
+   });
+   unsigned long long const MaxSize = _config->FindI("APT::Archives::Shared::MaxSize", 0) * 1024ull * 1024ull;
+   int const MaxAge = _config->FindI("APT::Archives::Shared::MaxAge", 0);
+   for (auto const &A : Archives)
+   {
+      if ((MaxSize == 0 || TotalSize <= MaxSize) &&
+	    (MaxAge <= 0 || Now - A.LastUsed <= MaxAge * 24 * 60 * 60))
+	 continue;
+      if (RemoveFile("CleanSharedArchives", A.File) == true)
+	 TotalSize -= A.Size;
+   }
+   return true;
+}
+									/*}}}*/
 // DoClean - Remove download archives					/*{{{*/
 bool DoClean(CommandLine &)
 {
@@ -332,7 +410,7 @@ bool DoClean(CommandLine &)
 
    pkgCacheFile::RemoveCaches();
 
-   return true;
+   return CleanSharedArchives();
 }
 									/*}}}*/
 // DoAutoClean - Smartly remove downloaded archives			/*{{{*/
@@ -373,6 +451,7 @@ bool DoAutoClean(CommandLine &)
    LogCleaner Cleaner;
 
    return Cleaner.Go(archivedir, *Cache) &&
-      Cleaner.Go(flCombine(archivedir, "partial/"), *Cache);
+      Cleaner.Go(flCombine(archivedir, "partial/"), *Cache) &&
+      CleanSharedArchives();
 }
 									/*}}}*/
@@ -0,0 +1,723 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   SAT - resolve the dependencies with a conflict driven clause learning
+   solver instead of the scores of the pkgProblemResolver.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/edsp.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/cacheiterators.h>
+#include <apt-pkg/strutl.h>
+
+#include <apt-private/private-sat.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/time.h>
+									/*}}}*/
+
+namespace {
+/* A literal is its variable shifted by one with the lowest bit set if the
+   variable is negated, so that the literals can index their watches */
+typedef unsigned int Lit;
+static constexpr unsigned int NoVar = std::numeric_limits<unsigned int>::max();
+static constexpr unsigned int NoClause = std::numeric_limits<unsigned int>::max();
+static constexpr Lit NoLit = std::numeric_limits<Lit>::max();
+static inline Lit PosLit(unsigned int const Var) { return Var << 1; }
+static inline Lit NegLit(unsigned int const Var) { return (Var << 1) | 1; }
+static inline unsigned int LitVar(Lit const L) { return L >> 1; }
+
+// CDCLSolver - small conflict driven clause learning solver		/*{{{*/
+/* Two watched literals, learning of the first unique implication point,
+   decisions by activity and restarts in the Luby sequence. The polarity of
+   a decision is always the preferred value of its variable, which keeps the
+   solutions close to it. Learnt clauses stay for the following calls of
+   Solve, which can be given assumptions to try out. */
+class CDCLSolver
+{
+   std::vector<std::vector<Lit>> Clauses;
+   std::vector<std::vector<unsigned int>> Watches;
+   std::vector<signed char> Assigns;
+   std::vector<bool> Preferred;
+   std::vector<unsigned int> Levels;
+   std::vector<unsigned int> Reasons;
+   std::vector<Lit> Trail;
+   std::vector<size_t> TrailLimits;
+   size_t QHead = 0;
+   std::vector<double> Activity;
+   double VarInc = 1;
+   std::vector<unsigned int> Heap;
+   std::vector<unsigned int> HeapIndex;
+   std::vector<bool> Seen;
+   bool Unsatisfiable = false;
+
+   inline signed char Value(Lit const L) const
+   {
+      signed char const A = Assigns[LitVar(L)];
+      return A < 0 ? A : (A ^ (L & 1));
+   }
+   inline void Enqueue(Lit const L, unsigned int const Reason)
+   {
+      unsigned int const Var = LitVar(L);
+      Assigns[Var] = (L & 1) ? 0 : 1;
+      Levels[Var] = TrailLimits.size();
+      Reasons[Var] = Reason;
+      Trail.push_back(L);
+   }
+   void HeapUp(size_t I);
+   void HeapDown(size_t I);
+   void HeapInsert(unsigned int const Var);
+   unsigned int HeapPop();
+   void Bump(unsigned int const Var);
+   unsigned int Propagate();
+   void Analyze(unsigned int Confl, std::vector<Lit> &Learnt, size_t &BtLevel);
+   void Backtrack(size_t const Level);
+
+public:
+   enum Result { SAT, UNSAT, UNKNOWN };
+   std::vector<bool> Model;
+   unsigned long OriginalClauses = 0, LearntClauses = 0;
+   unsigned long Conflicts = 0, Decisions = 0, Propagations = 0;
+
+   unsigned int NewVar(bool const Prefer);
+   unsigned int VarCount() const { return Assigns.size(); }
+   bool AddClause(std::vector<Lit> Lits);
+   Result Solve(std::vector<Lit> const &Assumptions, unsigned long const Budget);
+};
+									/*}}}*/
+unsigned int CDCLSolver::NewVar(bool const Prefer)			/*{{{*/
+{
+   unsigned int const Var = Assigns.size();
+   Watches.resize(Watches.size() + 2);
+   Assigns.push_back(-1);
+   Preferred.push_back(Prefer);
+   Levels.push_back(0);
+   Reasons.push_back(NoClause);
+   Activity.push_back(0);
+   HeapIndex.push_back(NoVar);
+   Seen.push_back(false);
+   HeapInsert(Var);
+   return Var;
+}
+									/*}}}*/
+// CDCLSolver::Heap* - variables ordered by activity			/*{{{*/
+void CDCLSolver::HeapUp(size_t I)
+{
+   unsigned int const Var = Heap[I];
+   while (I != 0)
+   {
+      size_t const Parent = (I - 1) / 2;
+      if ((Activity[Var] > Activity[Heap[Parent]]) == false)
+	 break;
+      Heap[I] = Heap[Parent];
+      HeapIndex[Heap[I]] = I;
+      I = Parent;
+   }
+   Heap[I] = Var;
+   HeapIndex[Var] = I;
+}
+void CDCLSolver::HeapDown(size_t I)
+{
+   unsigned int const Var = Heap[I];
+   while (true)
+   {
+      size_t Child = 2 * I + 1;
+      if (Child >= Heap.size())
+	 break;
+      if (Child + 1 < Heap.size() && Activity[Heap[Child + 1]] > Activity[Heap[Child]])
+	 ++Child;
+      if ((Activity[Heap[Child]] > Activity[Var]) == false)
+	 break;
+      Heap[I] = Heap[Child];
+      HeapIndex[Heap[I]] = I;
+      I = Child;
+   }
+   Heap[I] = Var;
+   HeapIndex[Var] = I;
+}
+void CDCLSolver::HeapInsert(unsigned int const Var)
+{
+   if (HeapIndex[Var] != NoVar)
+      return;
+   HeapIndex[Var] = Heap.size();
+   Heap.push_back(Var);
+   HeapUp(Heap.size() - 1);
+}
+unsigned int CDCLSolver::HeapPop()
+{
+   unsigned int const Var = Heap[0];
+   Heap[0] = Heap.back();
+   HeapIndex[Heap[0]] = 0;
+   Heap.pop_back();
+   HeapIndex[Var] = NoVar;
+   if (Heap.empty() == false)
+      HeapDown(0);
+   return Var;
+}
+void CDCLSolver::Bump(unsigned int const Var)
+{
+   Activity[Var] += VarInc;
+   if (Activity[Var] > 1e100)
+   {
+      for (auto &A : Activity)
+	 A *= 1e-100;
+      VarInc *= 1e-100;
+   }
+   if (HeapIndex[Var] != NoVar)
+      HeapUp(HeapIndex[Var]);
+}
+									/*}}}*/
+// CDCLSolver::AddClause - add a clause on the top level		/*{{{*/
+bool CDCLSolver::AddClause(std::vector<Lit> Lits)
+{
+   if (Unsatisfiable == true)
+      return false;
+   ++OriginalClauses;
+
+   // a literal and its negation are neighbours after sorting
+   std::sort(Lits.begin(), Lits.end());
+   size_t Size = 0;
+   for (size_t I = 0; I < Lits.size(); ++I)
+   {
+      signed char const V = Value(Lits[I]);
+      if (V == 1 || (Size != 0 && Lits[Size - 1] == (Lits[I] ^ 1)))
+	 return true;
+      if (V == 0 || (Size != 0 && Lits[Size - 1] == Lits[I]))
+	 continue;
+      Lits[Size++] = Lits[I];
+   }
+   Lits.resize(Size);
+
+   if (Size == 0)
+      Unsatisfiable = true;
+   else if (Size == 1)
+   {
+      Enqueue(Lits[0], NoClause);
+      if (Propagate() != NoClause)
+	 Unsatisfiable = true;
+   }
+   else
+   {
+      unsigned int const C = Clauses.size();
+      Watches[Lits[0]].push_back(C);
+      Watches[Lits[1]].push_back(C);
+      Clauses.push_back(std::move(Lits));
+   }
+   return Unsatisfiable == false;
+}
+									/*}}}*/
+// CDCLSolver::Propagate - assign all implied literals			/*{{{*/
+/* returns the conflicting clause if one is found */
+unsigned int CDCLSolver::Propagate()
+{
+   while (QHead < Trail.size())
+   {
+      Lit const False = Trail[QHead++] ^ 1;
+      ++Propagations;
+      std::vector<unsigned int> &Watching = Watches[False];
+      size_t I = 0, J = 0;
+      while (I < Watching.size())
+      {
+	 unsigned int const C = Watching[I++];
+	 std::vector<Lit> &Clause = Clauses[C];
+	 // the false literal is the second watch from now on
+	 if (Clause[0] == False)
+	    std::swap(Clause[0], Clause[1]);
+	 if (Value(Clause[0]) == 1)
+	 {
+	    Watching[J++] = C;
+	    continue;
+	 }
+
+	 bool Moved = false;
+	 for (size_t K = 2; K < Clause.size(); ++K)
+	    if (Value(Clause[K]) != 0)
+	    {
+	       std::swap(Clause[1], Clause[K]);
+	       Watches[Clause[1]].push_back(C);
+	       Moved = true;
+	       break;
+	    }
+	 if (Moved == true)
+	    continue;
+
+	 Watching[J++] = C;
+	 if (Value(Clause[0]) == 0)
+	 {
+	    while (I < Watching.size())
+	       Watching[J++] = Watching[I++];
+	    Watching.resize(J);
+	    QHead = Trail.size();
+	    return C;
+	 }
+	 Enqueue(Clause[0], C);
+      }
+      Watching.resize(J);
+   }
+   return NoClause;
+}
+									/*}}}*/
+// CDCLSolver::Analyze - learn the clause of the first implication point/*{{{*/
+void CDCLSolver::Analyze(unsigned int Confl, std::vector<Lit> &Learnt, size_t &BtLevel)
+{
+   Learnt.assign(1, NoLit);
+   size_t Open = 0;
+   Lit P = NoLit;
+   size_t Index = Trail.size();
+   do
+   {
+      std::vector<Lit> const &Clause = Clauses[Confl];
+      // the first literal of a reason is the one it implied
+      for (size_t K = (P == NoLit) ? 0 : 1; K < Clause.size(); ++K)
+      {
+	 unsigned int const Var = LitVar(Clause[K]);
+	 if (Seen[Var] == true || Levels[Var] == 0)
+	    continue;
+	 Seen[Var] = true;
+	 Bump(Var);
+	 if (Levels[Var] >= TrailLimits.size())
+	    ++Open;
+	 else
+	    Learnt.push_back(Clause[K]);
+      }
+      while (Seen[LitVar(Trail[--Index])] == false)
+	 ;
+      P = Trail[Index];
+      Confl = Reasons[LitVar(P)];
+      Seen[LitVar(P)] = false;
+      --Open;
+   } while (Open != 0);
+   Learnt[0] = P ^ 1;
+
+   BtLevel = 0;
+   for (size_t K = 1; K < Learnt.size(); ++K)
+   {
+      Seen[LitVar(Learnt[K])] = false;
+      if (Levels[LitVar(Learnt[K])] > BtLevel)
+      {
+	 BtLevel = Levels[LitVar(Learnt[K])];
+	 std::swap(Learnt[1], Learnt[K]);
+      }
+   }
+}
+									/*}}}*/
+// CDCLSolver::Backtrack - undo all assignments above the level		/*{{{*/
+void CDCLSolver::Backtrack(size_t const Level)
+{
+   if (TrailLimits.size() <= Level)
+      return;
+   for (size_t I = Trail.size(); I > TrailLimits[Level]; --I)
+   {
+      unsigned int const Var = LitVar(Trail[I - 1]);
+      Assigns[Var] = -1;
+      Reasons[Var] = NoClause;
+      HeapInsert(Var);
+   }
+   Trail.resize(TrailLimits[Level]);
+   TrailLimits.resize(Level);
+   QHead = Trail.size();
+}
+									/*}}}*/
+// CDCLSolver::Solve - search a model satisfying the assumptions	/*{{{*/
+/* Budget is the number of conflicts after which the search is given up */
+static unsigned long Luby(unsigned long X)
+{
+   unsigned long Size = 1, Seq = 0;
+   while (Size < X + 1)
+   {
+      ++Seq;
+      Size = 2 * Size + 1;
+   }
+   while (Size - 1 != X)
+   {
+      Size = (Size - 1) >> 1;
+      --Seq;
+      X = X % Size;
+   }
+   return 1ul << Seq;
+}
+CDCLSolver::Result CDCLSolver::Solve(std::vector<Lit> const &Assumptions, unsigned long const Budget)
+{
+   if (Unsatisfiable == true)
+      return UNSAT;
+   Backtrack(0);
+
+   unsigned long Spent = 0, Restarts = 0, SinceRestart = 0;
+   unsigned long Limit = 100 * Luby(Restarts);
+   std::vector<Lit> Learnt;
+   while (true)
+   {
+      unsigned int const Confl = Propagate();
+      if (Confl != NoClause)
+      {
+	 ++Conflicts;
+	 ++Spent;
+	 ++SinceRestart;
+	 if (TrailLimits.empty() == true)
+	 {
+	    Unsatisfiable = true;
+	    return UNSAT;
+	 }
+	 size_t BtLevel;
+	 Analyze(Confl, Learnt, BtLevel);
+	 Backtrack(BtLevel);
+	 if (Learnt.size() == 1)
+	    Enqueue(Learnt[0], NoClause);
+	 else
+	 {
+	    unsigned int const C = Clauses.size();
+	    Watches[Learnt[0]].push_back(C);
+	    Watches[Learnt[1]].push_back(C);
+	    Clauses.push_back(Learnt);
+	    Enqueue(Learnt[0], C);
+	    ++LearntClauses;
+	 }
+	 VarInc /= 0.95;
+	 continue;
+      }
+
+      if (Spent >= Budget)
+      {
+	 Backtrack(0);
+	 return UNKNOWN;
+      }
+      if (SinceRestart >= Limit)
+      {
+	 SinceRestart = 0;
+	 Limit = 100 * Luby(++Restarts);
+	 Backtrack(0);
+	 continue;
+      }
+
+      // the assumptions are the first decisions
+      Lit Next = NoLit;
+      while (TrailLimits.size() < Assumptions.size())
+      {
+	 Lit const A = Assumptions[TrailLimits.size()];
+	 signed char const V = Value(A);
+	 if (V == 1)
+	    TrailLimits.push_back(Trail.size());
+	 else if (V == 0)
+	 {
+	    Backtrack(0);
+	    return UNSAT;
+	 }
+	 else
+	 {
+	    Next = A;
+	    break;
+	 }
+      }
+
+      if (Next == NoLit)
+      {
+	 unsigned int Var = NoVar;
+	 while (Heap.empty() == false && Var == NoVar)
+	 {
+	    Var = HeapPop();
+	    if (Assigns[Var] >= 0)
+	       Var = NoVar;
+	 }
+	 if (Var == NoVar)
+	 {
+	    Model.resize(Assigns.size());
+	    for (size_t I = 0; I < Assigns.size(); ++I)
+	       Model[I] = Assigns[I] == 1;
+	    Backtrack(0);
+	    return SAT;
+	 }
+	 ++Decisions;
+	 Next = Preferred[Var] ? PosLit(Var) : NegLit(Var);
+      }
+      TrailLimits.push_back(Trail.size());
+      Enqueue(Next, NoClause);
+   }
+}
+									/*}}}*/
+static double Elapsed(struct timeval const &Start)			/*{{{*/
+{
+   struct timeval Now;
+   gettimeofday(&Now, NULL);
+   return (Now.tv_sec - Start.tv_sec) + (Now.tv_usec - Start.tv_usec) / 1000000.0;
+}
+									/*}}}*/
+}
+
+// ResolveBySAT - encode the cache as clauses and apply the model	/*{{{*/
+/* Each version a package can end up with gets a variable: the installed
+   version and the candidate of the policy, which includes the pins.
+   Packages without a variable set to true are not installed. */
+bool ResolveBySAT(pkgDepCache &Cache, std::list<std::string> const &Install,
+      std::list<std::string> const &Remove, unsigned int const Flags)
+{
+   bool const Debug = _config->FindB("Debug::APT::Solver::SAT", false);
+   bool const Improve = _config->FindB("APT::Solver::SAT::Improve", true);
+   bool const IgnoreHold = _config->FindB("APT::Ignore-Hold", false);
+   unsigned long const Budget = _config->FindI("APT::Solver::SAT::Conflicts", 100000);
+   struct timeval Start;
+   gettimeofday(&Start, NULL);
+
+   enum { NONE, INSTALL, REMOVE };
+   std::vector<unsigned char> Requested(Cache.Head().PackageCount, NONE);
+   for (auto const &Name : Install)
+   {
+      pkgCache::PkgIterator const Pkg = Cache.FindPkg(Name);
+      if (Pkg.end() == false)
+	 Requested[Pkg->ID] = INSTALL;
+   }
+   for (auto const &Name : Remove)
+   {
+      pkgCache::PkgIterator const Pkg = Cache.FindPkg(Name);
+      if (Pkg.end() == false)
+	 Requested[Pkg->ID] = REMOVE;
+   }
+
+   auto const IsHeld = [&](pkgCache::PkgIterator const &Pkg) {
+      return Pkg->SelectedState == pkgCache::State::Hold && IgnoreHold == false &&
+	 Requested[Pkg->ID] == NONE;
+   };
+   // the version the package should end up with if it can
+   auto const Wanted = [&](pkgCache::PkgIterator const &Pkg) {
+      if ((Flags & EDSP::Request::UPGRADE_ALL) != 0 && Pkg->CurrentVer != 0 &&
+	    Requested[Pkg->ID] == NONE && IsHeld(Pkg) == false &&
+	    Cache[Pkg].CandidateVer != 0)
+	 return Cache[Pkg].CandidateVerIter(Cache);
+      return Cache[Pkg].InstVerIter(Cache);
+   };
+
+   CDCLSolver Solver;
+   std::vector<unsigned int> VerVar(Cache.Head().VersionCount, NoVar);
+   std::vector<pkgCache::VerIterator> VarVer;
+   auto const AddVar = [&](pkgCache::PkgIterator const &Pkg, pkgCache::VerIterator const &Ver) {
+      VerVar[Ver->ID] = Solver.NewVar(Wanted(Pkg) == Ver);
+      VarVer.push_back(Ver);
+   };
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      if (Requested[Pkg->ID] == REMOVE)
+	 continue;
+      pkgCache::VerIterator const Cur = Pkg.CurrentVer();
+      pkgCache::VerIterator const Cand = Cache[Pkg].CandidateVerIter(Cache);
+      if (Cur.end() == false)
+	 AddVar(Pkg, Cur);
+      if (Cand.end() == true || Cand == Cur || IsHeld(Pkg) == true)
+	 continue;
+      if (Cur.end() == false || Requested[Pkg->ID] == INSTALL ||
+	    (Flags & EDSP::Request::FORBID_NEW_INSTALL) == 0)
+	 AddVar(Pkg, Cand);
+   }
+
+   auto const PkgVars = [&](pkgCache::PkgIterator const &Pkg) {
+      std::vector<unsigned int> Vars;
+      pkgCache::VerIterator const Cur = Pkg.CurrentVer();
+      pkgCache::VerIterator const Cand = Cache[Pkg].CandidateVerIter(Cache);
+      if (Cur.end() == false && VerVar[Cur->ID] != NoVar)
+	 Vars.push_back(VerVar[Cur->ID]);
+      if (Cand.end() == false && Cand != Cur && VerVar[Cand->ID] != NoVar)
+	 Vars.push_back(VerVar[Cand->ID]);
+      return Vars;
+   };
+
+   // the requests and what has to stay as it is
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      std::vector<unsigned int> const Vars = PkgVars(Pkg);
+      if (Vars.size() == 2)
+	 Solver.AddClause({NegLit(Vars[0]), NegLit(Vars[1])});
+
+      if (Requested[Pkg->ID] == INSTALL)
+      {
+	 pkgCache::VerIterator const Cand = Cache[Pkg].CandidateVerIter(Cache);
+	 if (Cand.end() == true)
+	    Solver.AddClause({});
+	 else
+	    Solver.AddClause({PosLit(VerVar[Cand->ID])});
+      }
+      else if (Pkg->CurrentVer != 0 && IsHeld(Pkg) == true)
+	 Solver.AddClause({PosLit(VerVar[Pkg.CurrentVer()->ID])});
+      else if (Pkg->CurrentVer != 0 && Requested[Pkg->ID] == NONE &&
+	    (Flags & EDSP::Request::FORBID_REMOVE) != 0)
+      {
+	 std::vector<Lit> Clause;
+	 for (auto const Var : Vars)
+	    Clause.push_back(PosLit(Var));
+	 Solver.AddClause(Clause);
+      }
+   }
+
+   // the critical dependencies of every version which can be installed
+   std::vector<Lit> Targets;
+   auto const AddTargets = [&](pkgCache::DepIterator const &D) {
+      pkgCache::PkgIterator const Target = D.TargetPkg();
+      if (D.IsIgnorable(Target) == false)
+      {
+	 pkgCache::VerIterator const Cur = Target.CurrentVer();
+	 pkgCache::VerIterator const Cand = Cache[Target].CandidateVerIter(Cache);
+	 if (Cur.end() == false && VerVar[Cur->ID] != NoVar && D.IsSatisfied(Cur) == true)
+	    Targets.push_back(PosLit(VerVar[Cur->ID]));
+	 if (Cand.end() == false && VerVar[Cand->ID] != NoVar && D.IsSatisfied(Cand) == true)
+	    Targets.push_back(PosLit(VerVar[Cand->ID]));
+      }
+      if (D->Type == pkgCache::Dep::Obsoletes)
+	 return;
+      for (pkgCache::PrvIterator Prv = Target.ProvidesList(); Prv.end() == false; ++Prv)
+	 if (VerVar[Prv.OwnerVer()->ID] != NoVar && D.IsIgnorable(Prv) == false &&
+	       D.IsSatisfied(Prv) == true)
+	    Targets.push_back(PosLit(VerVar[Prv.OwnerVer()->ID]));
+   };
+   for (unsigned int Var = 0; Var < VarVer.size(); ++Var)
+   {
+      for (pkgCache::DepIterator D = VarVer[Var].DependsList(); D.end() == false;)
+      {
+	 pkgCache::DepIterator Start, End;
+	 D.GlobOr(Start, End);
+	 if (Start.IsCritical() == false)
+	    continue;
+
+	 Targets.clear();
+	 for (pkgCache::DepIterator I = Start;; ++I)
+	 {
+	    AddTargets(I);
+	    if (I == End)
+	       break;
+	 }
+	 if (Start.IsNegative() == true)
+	    for (auto const T : Targets)
+	       Solver.AddClause({NegLit(Var), T ^ 1});
+	 else
+	 {
+	    Targets.push_back(NegLit(Var));
+	    Solver.AddClause(Targets);
+	 }
+      }
+   }
+   if (Debug == true)
+      ioprintf(std::clog, "SAT: %u variables and %lu clauses encoded in %.3fs\n",
+	    Solver.VarCount(), Solver.OriginalClauses, Elapsed(Start));
+
+   CDCLSolver::Result Result = Solver.Solve({}, Budget);
+   if (Result == CDCLSolver::UNSAT)
+      return _error->Error("The SAT solver found no way to satisfy the dependencies");
+   else if (Result == CDCLSolver::UNKNOWN)
+      return _error->Error("The SAT solver gave up after %lu conflicts", Budget);
+
+   auto const Chosen = [&](pkgCache::PkgIterator const &Pkg) {
+      for (auto const Var : PkgVars(Pkg))
+	 if (Solver.Model[Var] == true)
+	    return VarVer[Var];
+      return pkgCache::VerIterator(Cache.GetCache());
+   };
+   auto const Preferred = [&](pkgCache::PkgIterator const &Pkg) {
+      pkgCache::VerIterator const Ver = Wanted(Pkg);
+      if (Ver.end() == false && VerVar[Ver->ID] != NoVar)
+	 return Ver;
+      return pkgCache::VerIterator(Cache.GetCache());
+   };
+
+   /* The solver prefers the wanted states, but only for one decision at a
+      time. Try to lock in the preferred state of every package which has
+      another one in the model, the removal of installed packages first.
+      The budget is shared by all searches, so once it is spent the best
+      model found so far is used. */
+   unsigned long Solves = 1, Locked = 0;
+   bool OutOfBudget = false;
+   if (Improve == true)
+   {
+      std::vector<Lit> Assumptions;
+      std::vector<bool> Tried(Cache.Head().PackageCount, false);
+      std::vector<std::pair<int, pkgCache::PkgIterator>> Changed;
+      do
+      {
+	 Changed.clear();
+	 for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+	 {
+	    if (Tried[Pkg->ID] == true)
+	       continue;
+	    pkgCache::VerIterator const Ver = Chosen(Pkg);
+	    if (Ver == Preferred(Pkg))
+	       continue;
+	    int const Rank = Pkg->CurrentVer == 0 ? 2 : (Ver.end() == true ? 0 : 1);
+	    Changed.emplace_back(Rank, Pkg);
+	 }
+	 std::stable_sort(Changed.begin(), Changed.end(), [](std::pair<int, pkgCache::PkgIterator> const &A,
+		  std::pair<int, pkgCache::PkgIterator> const &B) { return A.first < B.first; });
+
+	 for (auto const &C : Changed)
+	 {
+	    if (Solver.Conflicts >= Budget)
+	    {
+	       OutOfBudget = true;
+	       break;
+	    }
+	    pkgCache::PkgIterator const &Pkg = C.second;
+	    Tried[Pkg->ID] = true;
+	    if (Chosen(Pkg) == Preferred(Pkg))
+	       continue;
+	    size_t const Size = Assumptions.size();
+	    pkgCache::VerIterator const Ver = Preferred(Pkg);
+	    if (Ver.end() == false)
+	       Assumptions.push_back(PosLit(VerVar[Ver->ID]));
+	    else
+	       for (auto const Var : PkgVars(Pkg))
+		  Assumptions.push_back(NegLit(Var));
+	    ++Solves;
+	    if (Solver.Solve(Assumptions, Budget - Solver.Conflicts) == CDCLSolver::SAT)
+	       ++Locked;
+	    else
+	       Assumptions.resize(Size);
+	 }
+      } while (Changed.empty() == false && OutOfBudget == false);
+   }
+   if (Debug == true && OutOfBudget == true)
+      ioprintf(std::clog, "SAT: all %lu conflicts are spent, not trying to keep more packages\n", Budget);
+   if (Debug == true)
+      ioprintf(std::clog, "SAT: %lu solves with %lu conflicts, %lu decisions, %lu propagations "
+	    "and %lu learnt clauses kept %lu packages as preferred in %.3fs\n",
+	    Solves, Solver.Conflicts, Solver.Decisions, Solver.Propagations,
+	    Solver.LearntClauses, Locked, Elapsed(Start));
+
+   // apply the model to the cache
+   pkgDepCache::ActionGroup group(Cache);
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+   {
+      pkgCache::VerIterator const Ver = Chosen(Pkg);
+      pkgDepCache::StateCache &State = Cache[Pkg];
+      bool const FromUser = Requested[Pkg->ID] != NONE;
+      if (Ver.end() == true)
+      {
+	 if (Pkg->CurrentVer != 0 && State.Delete() == false)
+	    Cache.MarkDelete(Pkg, false, 0, FromUser);
+	 else if (Pkg->CurrentVer == 0 && State.InstallVer != 0)
+	    Cache.MarkKeep(Pkg, false, FromUser);
+      }
+      else if (Ver == Pkg.CurrentVer())
+      {
+	 if (State.Keep() == false)
+	    Cache.MarkKeep(Pkg, false, FromUser);
+      }
+      else if (State.InstVerIter(Cache) != Ver)
+	 Cache.MarkInstall(Pkg, false, 0, FromUser);
+   }
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false; ++Pkg)
+      if (Cache[Pkg].InstVerIter(Cache) != Chosen(Pkg))
+	 return _error->Error("The solution of the SAT solver can't be applied to %s", Pkg.FullName().c_str());
+   if (Cache.BrokenCount() != 0)
+      return _error->Error("The solution of the SAT solver leaves %lu packages broken", Cache.BrokenCount());
+   return true;
+}
+									/*}}}*/
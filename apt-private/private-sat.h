@@ -0,0 +1,27 @@
+#ifndef APTPRIVATE_PRIVATE_SAT_H
+#define APTPRIVATE_PRIVATE_SAT_H
+
+#include <apt-pkg/macros.h>
+
+#include <list>
+#include <string>
+
+class pkgDepCache;
+
+/** \brief resolve the dependencies of the cache with a SAT solver
+ *
+ *  The critical dependencies, the candidates as chosen by the policy and
+ *  the requests are encoded into clauses, which are solved by a conflict
+ *  driven clause learning solver. The marks the cache has are the
+ *  preferred solution: the solver tries to change as few of them as it can.
+ *
+ *  \param Cache with the requests already marked
+ *  \param Install packages which have to be installed
+ *  \param Remove packages which have to be removed
+ *  \param Flags of the request as documented in #EDSP::Request::Flags
+ *  \return \b true if the solution was applied to the cache
+ */
+APT_PUBLIC bool ResolveBySAT(pkgDepCache &Cache, std::list<std::string> const &Install,
+      std::list<std::string> const &Remove, unsigned int const Flags);
+
+#endif
@@ -0,0 +1,166 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* ######################################################################
+
+   Solver - the parts of the solvers shipped with apt which talk EDSP,
+   so that they only have to bring their way of solving the request.
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/cacheiterators.h>
+#include <apt-pkg/cmndline.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/edsp.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/upgrade.h>
+
+#include <apt-private/private-cmndline.h>
+#include <apt-private/private-output.h>
+#include <apt-private/private-solver.h>
+
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+									/*}}}*/
+
+APT_NORETURN static void DIE(std::string const &message) {		/*{{{*/
+	std::cerr << "ERROR: " << message << std::endl;
+	_error->DumpErrors(std::cerr);
+	exit(EXIT_FAILURE);
+}
+									/*}}}*/
+static bool WriteSolution(pkgDepCache &Cache, FileFd &output, bool const Downgrades)/*{{{*/
+{
+   bool Okay = output.Failed() == false;
+   for (pkgCache::PkgIterator Pkg = Cache.PkgBegin(); Pkg.end() == false && likely(Okay); ++Pkg)
+   {
+      if (Cache[Pkg].Delete() == true)
+	 Okay &= EDSP::WriteSolutionStanza(output, "Remove", Pkg.CurrentVer());
+      else if (Cache[Pkg].NewInstall() == true || Cache[Pkg].Upgrade() == true ||
+	    (Downgrades == true && Cache[Pkg].Downgrade() == true))
+	 Okay &= EDSP::WriteSolutionStanza(output, "Install", Cache.GetCandidateVersion(Pkg));
+      else if (Cache[Pkg].Garbage == true)
+	 Okay &= EDSP::WriteSolutionStanza(output, "Autoremove", Pkg.CurrentVer());
+   }
+   return Okay;
+}
+									/*}}}*/
+// ResolveByInternal - solve the request with the problem resolver	/*{{{*/
+bool ResolveByInternal(pkgCacheFile &CacheFile, std::list<std::string> const &Install,
+      std::list<std::string> const &Remove, unsigned int const Flags)
+{
+	pkgProblemResolver Fix(CacheFile);
+	for (auto const &i : Remove) {
+		pkgCache::PkgIterator P = CacheFile->FindPkg(i);
+		Fix.Clear(P);
+		Fix.Protect(P);
+		Fix.Remove(P);
+	}
+	for (auto const &i : Install) {
+		pkgCache::PkgIterator P = CacheFile->FindPkg(i);
+		Fix.Clear(P);
+		Fix.Protect(P);
+	}
+	for (auto const &i : Install)
+		CacheFile->MarkInstall(CacheFile->FindPkg(i), true);
+
+	if (Flags & EDSP::Request::UPGRADE_ALL) {
+		int upgrade_flags = APT::Upgrade::ALLOW_EVERYTHING;
+		if (Flags & EDSP::Request::FORBID_NEW_INSTALL)
+		   upgrade_flags |= APT::Upgrade::FORBID_INSTALL_NEW_PACKAGES;
+		if (Flags & EDSP::Request::FORBID_REMOVE)
+		   upgrade_flags |= APT::Upgrade::FORBID_REMOVE_PACKAGES;
+		return APT::Upgrade::Upgrade(CacheFile, upgrade_flags);
+	}
+	return Fix.Resolve();
+}
+									/*}}}*/
+// RunEDSPSolver - answer the request of apt on stdin			/*{{{*/
+int RunEDSPSolver(CommandLine &CmdL, char const * const Name, EDSPSolverFunction const &Solve,
+      bool const Downgrades)
+{
+	// Deal with stdout not being a tty
+	if (!isatty(STDOUT_FILENO) && _config->FindI("quiet", -1) == -1)
+		_config->Set("quiet","1");
+
+	if (_config->FindI("quiet", 0) < 1)
+		_config->Set("Debug::EDSP::WriteSolution", true);
+
+	_config->Set("APT::System", "Debian APT solver interface");
+	_config->Set("APT::Solver", "internal");
+	_config->Set("edsp::scenario", "/nonexistent/stdin");
+	_config->Clear("Dir::Log");
+	FileFd output;
+	if (output.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly | FileFd::BufferedWrite, true) == false)
+	   DIE("stdout couldn't be opened");
+	int const input = STDIN_FILENO;
+	SetNonBlock(input, false);
+
+	EDSP::WriteProgress(0, "Start up solver…", output);
+
+	if (pkgInitSystem(*_config,_system) == false)
+		DIE("System could not be initialized!");
+
+	EDSP::WriteProgress(1, "Read request…", output);
+
+	if (WaitFd(input, false, 5) == false)
+		DIE("WAIT timed out in the resolver");
+
+	std::list<std::string> install, remove;
+	unsigned int flags;
+	if (EDSP::ReadRequest(input, install, remove, flags) == false)
+		DIE("Parsing the request failed!");
+
+	EDSP::WriteProgress(5, "Read scenario…", output);
+
+	pkgCacheFile CacheFile;
+	if (CacheFile.Open(NULL, false) == false)
+		DIE("Failed to open CacheFile!");
+
+	EDSP::WriteProgress(50, "Apply request on scenario…", output);
+
+	if (EDSP::ApplyRequest(install, remove, CacheFile) == false)
+		DIE("Failed to apply request to depcache!");
+
+	std::string const progress = std::string("Call ") + Name + " on current scenario…";
+	EDSP::WriteProgress(60, progress.c_str(), output);
+
+	if (Solve(CacheFile, install, remove, flags) == false) {
+		std::string failure;
+		if ((flags & EDSP::Request::UPGRADE_ALL) == 0)
+			failure = "ERR_UNSOLVABLE";
+		else if (flags & (EDSP::Request::FORBID_NEW_INSTALL | EDSP::Request::FORBID_REMOVE))
+			failure = "ERR_UNSOLVABLE_UPGRADE";
+		else
+			failure = "ERR_UNSOLVABLE_FULL_UPGRADE";
+		std::ostringstream broken;
+		ShowBroken(broken, CacheFile, false);
+		_error->DumpErrors(broken);
+		EDSP::WriteError(failure.c_str(), broken.str(), output);
+		return 0;
+	}
+
+	EDSP::WriteProgress(95, "Write solution…", output);
+
+	if (WriteSolution(CacheFile, output, Downgrades) == false)
+		DIE("Failed to output the solution!");
+
+	EDSP::WriteProgress(100, "Done", output);
+
+	return DispatchCommandLine(CmdL, {});
+}
+									/*}}}*/
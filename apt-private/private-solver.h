@@ -0,0 +1,47 @@
+#ifndef APTPRIVATE_PRIVATE_SOLVER_H
+#define APTPRIVATE_PRIVATE_SOLVER_H
+
+#include <apt-pkg/macros.h>
+
+#include <functional>
+#include <list>
+#include <string>
+
+class CommandLine;
+class pkgCacheFile;
+
+/** \brief a solver run by #RunEDSPSolver
+ *
+ *  \param CacheFile with the request already applied
+ *  \param Install packages which have to be installed
+ *  \param Remove packages which have to be removed
+ *  \param Flags of the request as documented in #EDSP::Request::Flags
+ *  \return \b true if the cache holds a solution
+ */
+typedef std::function<bool(pkgCacheFile &CacheFile, std::list<std::string> const &Install,
+      std::list<std::string> const &Remove, unsigned int const Flags)> EDSPSolverFunction;
+
+/** \brief read an EDSP request from stdin and write the solution to stdout
+ *
+ *  The scenario and the request are read, the given solver is called on
+ *  them and its solution or an error is written in the format an external
+ *  solver has to use.
+ *
+ *  \param CmdL as parsed by the solver
+ *  \param Name of the solver in the progress reports
+ *  \param Solve is called with the request applied to the cache
+ *  \param Downgrades are written as Install if \b true, the problemresolver
+ *  never wrote them, so they are skipped otherwise
+ *  \return exit code of the solver
+ */
+APT_PUBLIC int RunEDSPSolver(CommandLine &CmdL, char const * const Name, EDSPSolverFunction const &Solve,
+      bool const Downgrades);
+
+/** \brief resolve the request with the pkgProblemResolver
+ *
+ *  Upgrade requests are solved with APT::Upgrade::Upgrade.
+ */
+APT_PUBLIC bool ResolveByInternal(pkgCacheFile &CacheFile, std::list<std::string> const &Install,
+      std::list<std::string> const &Remove, unsigned int const Flags);
+
+#endif
@@ -0,0 +1,116 @@
+// -*- mode: cpp; mode: fold -*-
+// Description								/*{{{*/
+/* #####################################################################
+
+   cover around the SAT solver to be able to run it like an external
+
+   ##################################################################### */
+									/*}}}*/
+// Include Files							/*{{{*/
+#include <config.h>
+
+#include <apt-pkg/error.h>
+#include <apt-pkg/cmndline.h>
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+
+#include <apt-private/private-cmndline.h>
+#include <apt-private/private-main.h>
+#include <apt-private/private-sat.h>
+#include <apt-private/private-solver.h>
+
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include <apti18n.h>
+									/*}}}*/
+
+static bool ShowHelp(CommandLine &)					/*{{{*/
+{
+	std::cout <<
+		_("Usage: apt-sat-solver\n"
+		"\n"
+		"apt-sat-solver resolves the dependencies of a request with a\n"
+		"SAT solver instead of the internal resolver of the APT family,\n"
+		"using the interface of an external solver.\n");
+	return true;
+}
+									/*}}}*/
+static std::vector<aptDispatchWithHelp> GetCommands()			/*{{{*/
+{
+   return {};
+}
+									/*}}}*/
+static void ReportSolution(char const * const Solver, pkgDepCache &Cache,/*{{{*/
+      bool const Solved, struct timeval const &Start)
+{
+   struct timeval Now;
+   gettimeofday(&Now, NULL);
+   double const Elapsed = (Now.tv_sec - Start.tv_sec) + (Now.tv_usec - Start.tv_usec) / 1000000.0;
+   if (Solved == false)
+      ioprintf(std::clog, "%s: no solution found in %.3fs\n", Solver, Elapsed);
+   else
+      ioprintf(std::clog, "%s: %lu to install or upgrade, %lu to remove, %lu not upgraded, %lu broken in %.3fs\n",
+	    Solver, Cache.InstCount(), Cache.DelCount(), Cache.KeepCount(), Cache.BrokenCount(), Elapsed);
+}
+									/*}}}*/
+// CompareWithInternal - try the request with the internal resolver	/*{{{*/
+/* The changes are undone with a snapshot of the cache, only the protected
+   flags of the requested packages stay – the SAT solver keeps them anyhow. */
+static void CompareWithInternal(pkgCacheFile &CacheFile, std::list<std::string> const &install,
+      std::list<std::string> const &remove, unsigned int const flags)
+{
+	pkgDepCache::ActionGroup group(CacheFile);
+	unsigned long const snapshot = CacheFile->Snapshot();
+	_error->PushToStack();
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	bool const solved = ResolveByInternal(CacheFile, install, remove, flags);
+	ReportSolution("internal", CacheFile, solved, start);
+	_error->RevertToStack();
+	CacheFile->Rollback(snapshot);
+	CacheFile->ForgetSnapshot(snapshot);
+}
+									/*}}}*/
+static bool SolveBySAT(pkgCacheFile &CacheFile, std::list<std::string> const &install,/*{{{*/
+      std::list<std::string> const &remove, unsigned int const flags)
+{
+	// protected, so that the auto-installer doesn't discard the requested
+	// candidates it can't satisfy – the SAT solver has to consider them
+	for (auto const &i : install) {
+		pkgCache::PkgIterator P = CacheFile->FindPkg(i);
+		if (P.end() == true)
+			continue;
+		CacheFile->MarkProtected(P);
+		CacheFile->MarkInstall(P, true);
+	}
+
+	bool const compare = _config->FindB("APT::Solver::SAT::Compare", false);
+	if (compare == true)
+		CompareWithInternal(CacheFile, install, remove, flags);
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	bool const solved = ResolveBySAT(CacheFile, install, remove, flags);
+	if (compare == true)
+		ReportSolution("sat", CacheFile, solved, start);
+	return solved;
+}
+									/*}}}*/
+int main(int argc,const char *argv[])					/*{{{*/
+{
+	// we really don't need anything
+	DropPrivileges();
+
+	CommandLine CmdL;
+	ParseCommandLine(CmdL, APT_CMD::APT_INTERNAL_SOLVER, &_config, NULL, argc, argv, &ShowHelp, &GetCommands);
+
+	return RunEDSPSolver(CmdL, "SAT solver", &SolveBySAT, true);
+}
+									/*}}}*/
@@ -22,15 +22,27 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <time.h>
 #include <unistd.h>
 #include <sstream>
 #include <string.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
 #include<set>
 #include<string>
+#include <vector>
 
 // Internet stuff
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 
@@ -43,11 +55,19 @@ static std::string LastHost;
 static int LastPort = 0;
 static struct addrinfo *LastHostAddr = 0;
 static struct addrinfo *LastUsed = 0;
+// LastHostAddr might be chained together from multiple getaddrinfo results
+static std::vector<struct addrinfo *> LastHostAddrParts;
+static bool LastHostAddrFromCache = false;
 
 static std::vector<SrvRec> SrvRecords;
 
 // Set of IP/hostnames that we timed out before or couldn't resolve
 static std::set<std::string> bad_addr;
+// Address family the last connection to a host was established with
+static std::map<std::string, int> PreferredFamily;
+
+// Results of lookups done by us and other methods keyed by the lookup
+static std::map<std::string, std::string> ResolverCache;
 
 // RotateDNS - Select a new server from a DNS rotation			/*{{{*/
 // ---------------------------------------------------------------------
@@ -76,25 +96,114 @@ static bool ConnectionAllowed(char const * const Service, std::string const &Hos
    return true;
 }
 									/*}}}*/
-// DoConnect - Attempt a connect operation				/*{{{*/
+// AddResolverCache - Take over lookup results of other methods	/*{{{*/
 // ---------------------------------------------------------------------
-/* This helper function attempts a connection to a single address. */
-static bool DoConnect(struct addrinfo *Addr,std::string const &Host,
-		      unsigned long TimeOut,int &Fd,pkgAcqMethod *Owner)
+/* The acquire system passes on what the methods reported in the
+   Resolver-Cache field as space separated key=value entries. */
+void AddResolverCache(std::string const &Entries)
 {
-   // Show a status indicator
+   for (auto const &Entry : VectorizeString(Entries, ' '))
+   {
+      size_t const Equal = Entry.find('=');
+      if (Equal == std::string::npos || Equal == 0)
+	 continue;
+      ResolverCache[Entry.substr(0, Equal)] = Entry.substr(Equal + 1);
+   }
+}
+									/*}}}*/
+// ShareResolverResult - Report the result of a lookup			/*{{{*/
+// ---------------------------------------------------------------------
+/* Other methods started by the acquire system later on will get it with
+   their items and don't need to repeat the lookup. */
+static void ShareResolverResult(std::string const &Key, std::string const &Value,
+      std::string const &Host, pkgAcqMethod * const Owner)
+{
+   ResolverCache[Key] = Value;
+   Owner->ResolverResult(Key, Value, _("Connecting to %s"), Host.c_str());
+}
+									/*}}}*/
+// FreeLastHostAddr - Free the addresses of the last host		/*{{{*/
+static void FreeLastHostAddr()
+{
+   // undo the chaining so that each result is freed on its own
+   for (auto Part = LastHostAddrParts.begin(); Part != LastHostAddrParts.end(); ++Part)
+   {
+      auto const Next = Part + 1;
+      if (Next == LastHostAddrParts.end())
+	 break;
+      struct addrinfo *Tail = *Part;
+      while (Tail->ai_next != *Next)
+	 Tail = Tail->ai_next;
+      Tail->ai_next = 0;
+   }
+   for (auto const Part : LastHostAddrParts)
+      freeaddrinfo(Part);
+   LastHostAddrParts.clear();
+   LastHostAddr = 0;
+   LastUsed = 0;
+   LastHostAddrFromCache = false;
+}
+									/*}}}*/
+// ResolveFromCache - Get the addresses of a host from the cache	/*{{{*/
+// ---------------------------------------------------------------------
+/* The entries are comma separated numeric addresses, which are converted
+   without asking any nameserver. Returns false if no address is usable. */
+static bool ResolveFromCache(std::string const &Entry, char const * const ServStr,
+      struct addrinfo Hints)
+{
+   Hints.ai_flags |= AI_NUMERICHOST;
+   for (auto const &Address : VectorizeString(Entry, ','))
+   {
+      struct addrinfo *Res = 0;
+      if (getaddrinfo(Address.c_str(), ServStr, &Hints, &Res) != 0 || Res == 0)
+	 continue;
+      if (LastHostAddrParts.empty() == false)
+      {
+	 struct addrinfo *Tail = LastHostAddrParts.back();
+	 while (Tail->ai_next != 0)
+	    Tail = Tail->ai_next;
+	 Tail->ai_next = Res;
+      }
+      LastHostAddrParts.push_back(Res);
+   }
+   if (LastHostAddrParts.empty() == true)
+      return false;
+   LastHostAddr = LastHostAddrParts.front();
+   return true;
+}
+									/*}}}*/
+// ConnectAttempt - A single nonblocking connect to one address	/*{{{*/
+struct ConnectAttempt
+{
+   struct addrinfo *Addr;
+   int Fd;
    char Name[NI_MAXHOST];
    char Service[NI_MAXSERV];
-   
-   Name[0] = 0;   
-   Service[0] = 0;
+   std::chrono::steady_clock::time_point Deadline;
+
+   explicit ConnectAttempt(struct addrinfo * const Addr) : Addr(Addr), Fd(-1)
+   {
+      Name[0] = 0;
+      Service[0] = 0;
+   }
+};
+									/*}}}*/
+// StartConnect - Initiate a connect operation				/*{{{*/
+// ---------------------------------------------------------------------
+/* This helper function starts a nonblocking connection to a single
+   address, FinishConnect checks the outcome once the socket is writable. */
+static bool StartConnect(ConnectAttempt &Attempt,std::string const &Host,
+		      unsigned long TimeOut,pkgAcqMethod *Owner)
+{
+   struct addrinfo * const Addr = Attempt.Addr;
+   // Show a status indicator
    getnameinfo(Addr->ai_addr,Addr->ai_addrlen,
-	       Name,sizeof(Name),Service,sizeof(Service),
+	       Attempt.Name,sizeof(Attempt.Name),Attempt.Service,sizeof(Attempt.Service),
 	       NI_NUMERICHOST|NI_NUMERICSERV);
-   Owner->Status(_("Connecting to %s (%s)"),Host.c_str(),Name);
+   Owner->Status(_("Connecting to %s (%s)"),Host.c_str(),Attempt.Name);
 
    // if that addr did timeout before, we do not try it again
-   if(bad_addr.find(std::string(Name)) != bad_addr.end())
+   if(bad_addr.find(std::string(Attempt.Name)) != bad_addr.end())
       return false;
 
    /* If this is an IP rotation store the IP we are using.. If something goes
@@ -102,37 +211,38 @@ static bool DoConnect(struct addrinfo *Addr,std::string const &Host,
    if (LastHostAddr->ai_next != 0)
    {
       std::stringstream ss;
-      ioprintf(ss, _("[IP: %s %s]"),Name,Service);
+      ioprintf(ss, _("[IP: %s %s]"),Attempt.Name,Attempt.Service);
       Owner->SetIP(ss.str());
    }
-      
+
    // Get a socket
-   if ((Fd = socket(Addr->ai_family,Addr->ai_socktype,
+   if ((Attempt.Fd = socket(Addr->ai_family,Addr->ai_socktype,
 		    Addr->ai_protocol)) < 0)
       return _error->Errno("socket",_("Could not create a socket for %s (f=%u t=%u p=%u)"),
-			   Name,Addr->ai_family,Addr->ai_socktype,Addr->ai_protocol);
-   
-   SetNonBlock(Fd,true);
-   if (connect(Fd,Addr->ai_addr,Addr->ai_addrlen) < 0 &&
+			   Attempt.Name,Addr->ai_family,Addr->ai_socktype,Addr->ai_protocol);
+
+   SetNonBlock(Attempt.Fd,true);
+   if (connect(Attempt.Fd,Addr->ai_addr,Addr->ai_addrlen) < 0 &&
        errno != EINPROGRESS)
       return _error->Errno("connect",_("Cannot initiate the connection "
-			   "to %s:%s (%s)."),Host.c_str(),Service,Name);
-   
+			   "to %s:%s (%s)."),Host.c_str(),Attempt.Service,Attempt.Name);
+
    /* This implements a timeout for connect by opening the connection
       nonblocking */
-   if (WaitFd(Fd,true,TimeOut) == false) {
-      bad_addr.insert(bad_addr.begin(), std::string(Name));
-      Owner->SetFailReason("Timeout");
-      return _error->Error(_("Could not connect to %s:%s (%s), "
-			   "connection timed out"),Host.c_str(),Service,Name);
-   }
-
+   Attempt.Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(TimeOut);
+   return true;
+}
+									/*}}}*/
+// FinishConnect - Check the result of a connect operation		/*{{{*/
+static bool FinishConnect(ConnectAttempt const &Attempt,std::string const &Host,
+		      pkgAcqMethod *Owner)
+{
    // Check the socket for an error condition
    unsigned int Err;
    unsigned int Len = sizeof(Err);
-   if (getsockopt(Fd,SOL_SOCKET,SO_ERROR,&Err,&Len) != 0)
+   if (getsockopt(Attempt.Fd,SOL_SOCKET,SO_ERROR,&Err,&Len) != 0)
       return _error->Errno("getsockopt",_("Failed"));
-   
+
    if (Err != 0)
    {
       errno = Err;
@@ -140,14 +250,44 @@ static bool DoConnect(struct addrinfo *Addr,std::string const &Host,
          Owner->SetFailReason("ConnectionRefused");
       else if (errno == ETIMEDOUT)
 	 Owner->SetFailReason("ConnectionTimedOut");
-      bad_addr.insert(bad_addr.begin(), std::string(Name));
+      bad_addr.insert(bad_addr.begin(), std::string(Attempt.Name));
       return _error->Errno("connect",_("Could not connect to %s:%s (%s)."),Host.c_str(),
-			   Service,Name);
+			   Attempt.Service,Attempt.Name);
    }
-   
+
    return true;
 }
 									/*}}}*/
+// TimeoutConnect - Give up on a connect operation			/*{{{*/
+static void TimeoutConnect(ConnectAttempt const &Attempt,std::string const &Host,
+		      pkgAcqMethod *Owner)
+{
+   bad_addr.insert(bad_addr.begin(), std::string(Attempt.Name));
+   Owner->SetFailReason("Timeout");
+   _error->Error(_("Could not connect to %s:%s (%s), "
+			"connection timed out"),Host.c_str(),Attempt.Service,Attempt.Name);
+}
+									/*}}}*/
+// OrderAddresses - Interleave the address families			/*{{{*/
+// ---------------------------------------------------------------------
+/* As described in RFC 8305 the addresses are tried alternating between
+   the families, so that a family which is broken on the path to the host
+   only ever delays the connection, starting with the given family. */
+static void OrderAddresses(std::vector<struct addrinfo *> &Addresses, int const First)
+{
+   std::vector<struct addrinfo *> Preferred, Other;
+   for (auto const Addr : Addresses)
+      (Addr->ai_family == First ? Preferred : Other).push_back(Addr);
+   Addresses.clear();
+   for (size_t i = 0; i < Preferred.size() || i < Other.size(); ++i)
+   {
+      if (i < Preferred.size())
+	 Addresses.push_back(Preferred[i]);
+      if (i < Other.size())
+	 Addresses.push_back(Other[i]);
+   }
+}
+									/*}}}*/
 // Connect to a given Hostname						/*{{{*/
 static bool ConnectToHostname(std::string const &Host, int const Port,
       const char * const Service, int DefPort, int &Fd,
@@ -170,13 +310,9 @@ static bool ConnectToHostname(std::string const &Host, int const Port,
       Owner->Status(_("Connecting to %s"),Host.c_str());
 
       // Free the old address structure
-      if (LastHostAddr != 0)
-      {
-	 freeaddrinfo(LastHostAddr);
-	 LastHostAddr = 0;
-	 LastUsed = 0;
-      }
-      
+      FreeLastHostAddr();
+      LastHost.clear();
+
       // We only understand SOCK_STREAM sockets.
       struct addrinfo Hints;
       memset(&Hints,0,sizeof(Hints));
@@ -204,8 +340,13 @@ static bool ConnectToHostname(std::string const &Host, int const Port,
       if(bad_addr.find(Host) != bad_addr.end()) 
 	 return _error->Error(_("Could not resolve '%s'"),Host.c_str());
 
+      // Another method might have resolved it for us already
+      std::string const CacheKey = "addr:" + Host;
+      auto const Cached = ResolverCache.find(CacheKey);
+      if (Cached != ResolverCache.end() && ResolveFromCache(Cached->second, ServStr, Hints) == true)
+	 LastHostAddrFromCache = true;
       // Resolve both the host and service simultaneously
-      while (1)
+      else while (1)
       {
 	 int Res;
 	 if ((Res = getaddrinfo(Host.c_str(),ServStr,&Hints,&LastHostAddr)) != 0 ||
@@ -236,53 +377,207 @@ static bool ConnectToHostname(std::string const &Host, int const Port,
 	    return _error->Error(_("Something wicked happened resolving '%s:%s' (%i - %s)"),
 				 Host.c_str(),ServStr,Res,gai_strerror(Res));
 	 }
+	 LastHostAddrParts.push_back(LastHostAddr);
+
+	 std::string Addresses;
+	 for (struct addrinfo *Addr = LastHostAddr; Addr != 0; Addr = Addr->ai_next)
+	 {
+	    char Name[NI_MAXHOST];
+	    if ((Addr->ai_family != AF_INET && Addr->ai_family != AF_INET6) ||
+		  getnameinfo(Addr->ai_addr, Addr->ai_addrlen, Name, sizeof(Name),
+		     0, 0, NI_NUMERICHOST) != 0)
+	       continue;
+	    if (Addresses.empty() == false)
+	       Addresses.append(",");
+	    Addresses.append(Name);
+	 }
+	 if (Addresses.empty() == false)
+	    ShareResolverResult(CacheKey, Addresses, Host, Owner);
 	 break;
       }
-      
+
       LastHost = Host;
       LastPort = Port;
    }
 
-   // When we have an IP rotation stay with the last IP.
-   struct addrinfo *CurHost = LastHostAddr;
-   if (LastUsed != 0)
-       CurHost = LastUsed;
-   
-   while (CurHost != 0)
+   /* When we have an IP rotation stay with the last IP, otherwise start
+      with the family which worked for this host before */
+   struct addrinfo * const Start = (LastUsed != 0) ? LastUsed : LastHostAddr;
+   std::vector<struct addrinfo *> Addresses;
+   for (struct addrinfo *CurHost = Start; CurHost != 0; CurHost = CurHost->ai_next)
+      // Ignore UNIX domain sockets
+      if (CurHost->ai_family != AF_UNIX)
+	 Addresses.push_back(CurHost);
+   for (struct addrinfo *CurHost = LastHostAddr; CurHost != Start; CurHost = CurHost->ai_next)
+      if (CurHost->ai_family != AF_UNIX)
+	 Addresses.push_back(CurHost);
+   if (Addresses.empty() == false)
+   {
+      int First = Addresses.front()->ai_family;
+      auto const Preferred = PreferredFamily.find(Host);
+      if (LastUsed == 0 && Preferred != PreferredFamily.end())
+	 First = Preferred->second;
+      OrderAddresses(Addresses, First);
+   }
+
+   /* Race the connections: the next address gets a go if the previous
+      attempts haven't succeeded after a short delay or all failed */
+   auto const AttemptDelay = std::chrono::milliseconds(
+	 std::max(0, _config->FindI("Acquire::Connect::AttemptDelay", 250)));
+   std::vector<ConnectAttempt> Running;
+   auto Next = Addresses.cbegin();
+   auto NextStart = std::chrono::steady_clock::now();
+   bool const Debug = _config->FindB("Debug::Acquire::Connect", false);
+   while (Next != Addresses.cend() || Running.empty() == false)
    {
-      if (DoConnect(CurHost,Host,TimeOut,Fd,Owner) == true)
+      auto Now = std::chrono::steady_clock::now();
+      if (Next != Addresses.cend() && (Running.empty() == true || Now >= NextStart))
       {
-	 LastUsed = CurHost;
-	 return true;
-      }      
-      close(Fd);
-      Fd = -1;
-      
-      // Ignore UNIX domain sockets
-      do
+	 ConnectAttempt Attempt(*Next++);
+	 // only keep the errors of the last failed attempt around
+	 _error->Discard();
+	 if (StartConnect(Attempt, Host, TimeOut, Owner) == true)
+	 {
+	    if (Debug == true)
+	       std::clog << "Connecting to " << Host << " via " << Attempt.Name << std::endl;
+	    Running.push_back(Attempt);
+	    NextStart = Now + AttemptDelay;
+	 }
+	 else if (Attempt.Fd != -1)
+	    close(Attempt.Fd);
+	 continue;
+      }
+
+      // wait for an attempt to finish or time out or the next one to be due
+      auto Until = Running.front().Deadline;
+      fd_set Set;
+      FD_ZERO(&Set);
+      int MaxFd = -1;
+      for (auto const &Attempt : Running)
       {
-	 CurHost = CurHost->ai_next;
+	 FD_SET(Attempt.Fd, &Set);
+	 MaxFd = std::max(MaxFd, Attempt.Fd);
+	 Until = std::min(Until, Attempt.Deadline);
+      }
+      if (Next != Addresses.cend())
+	 Until = std::min(Until, NextStart);
+      auto const Wait = std::chrono::duration_cast<std::chrono::microseconds>(
+	    std::max(Until - Now, std::chrono::steady_clock::duration::zero()));
+      struct timeval tv;
+      tv.tv_sec = Wait.count() / 1000000;
+      tv.tv_usec = Wait.count() % 1000000;
+      if (select(MaxFd + 1, nullptr, &Set, nullptr, &tv) < 0)
+      {
+	 if (errno == EINTR)
+	    continue;
+	 for (auto const &Attempt : Running)
+	    close(Attempt.Fd);
+	 return _error->Errno("select", "Failed to wait for the connection to %s", Host.c_str());
       }
-      while (CurHost != 0 && CurHost->ai_family == AF_UNIX);
 
-      /* If we reached the end of the search list then wrap around to the
-         start */
-      if (CurHost == 0 && LastUsed != 0)
-	 CurHost = LastHostAddr;
-      
-      // Reached the end of the search cycle
-      if (CurHost == LastUsed)
-	 break;
-      
-      if (CurHost != 0)
-	 _error->Discard();
-   }   
+      Now = std::chrono::steady_clock::now();
+      for (auto Attempt = Running.begin(); Attempt != Running.end();)
+      {
+	 bool Failed = false;
+	 if (FD_ISSET(Attempt->Fd, &Set))
+	 {
+	    _error->Discard();
+	    if (FinishConnect(*Attempt, Host, Owner) == true)
+	    {
+	       for (auto const &Other : Running)
+		  if (Other.Fd != Attempt->Fd)
+		     close(Other.Fd);
+	       if (LastHostAddr->ai_next != 0)
+	       {
+		  std::stringstream ss;
+		  ioprintf(ss, _("[IP: %s %s]"),Attempt->Name,Attempt->Service);
+		  Owner->SetIP(ss.str());
+	       }
+	       if (Debug == true)
+		  std::clog << "Connected to " << Host << " via " << Attempt->Name << std::endl;
+	       Fd = Attempt->Fd;
+	       LastUsed = Attempt->Addr;
+	       PreferredFamily[Host] = Attempt->Addr->ai_family;
+	       return true;
+	    }
+	    Failed = true;
+	 }
+	 else if (Now >= Attempt->Deadline)
+	 {
+	    _error->Discard();
+	    TimeoutConnect(*Attempt, Host, Owner);
+	    Failed = true;
+	 }
+
+	 if (Failed == true)
+	 {
+	    close(Attempt->Fd);
+	    Attempt = Running.erase(Attempt);
+	    // the next address doesn't need to wait for this one anymore
+	    NextStart = Now;
+	 }
+	 else
+	    ++Attempt;
+      }
+   }
+
+   // the addresses we got from another method might be outdated by now,
+   // so try again with our own lookup but keep the errors if that fails, too
+   if (LastHostAddrFromCache == true)
+   {
+      ResolverCache.erase("addr:" + Host);
+      FreeLastHostAddr();
+      LastHost.clear();
+      _error->PushToStack();
+      bool const Connected = ConnectToHostname(Host, Port, Service, DefPort, Fd, TimeOut, Owner);
+      if (Connected == true)
+	 _error->RevertToStack();
+      else
+	 _error->MergeWithStack();
+      return Connected;
+   }
 
    if (_error->PendingError() == true)
       return false;   
    return _error->Error(_("Unable to connect to %s:%s:"),Host.c_str(),ServStr);
 }
 									/*}}}*/
+// GetCachedSrvRecords - GetSrvRecords with the resolver cache		/*{{{*/
+// ---------------------------------------------------------------------
+/* The records are cached as comma separated target/port/priority/weight
+   entries, no records at all as an empty entry. */
+static void GetCachedSrvRecords(std::string const &Host, int const Port,
+      std::vector<SrvRec> &Result, pkgAcqMethod * const Owner)
+{
+   std::string const CacheKey = "srv:" + Host + ":" + std::to_string(Port);
+   auto const Cached = ResolverCache.find(CacheKey);
+   if (Cached != ResolverCache.end())
+   {
+      for (auto const &Record : VectorizeString(Cached->second, ','))
+      {
+	 auto const Fields = VectorizeString(Record, '/');
+	 if (Fields.size() != 4)
+	    continue;
+	 Result.emplace_back(Fields[0], atoi(Fields[2].c_str()), atoi(Fields[3].c_str()),
+	       atoi(Fields[1].c_str()));
+      }
+      std::stable_sort(Result.begin(), Result.end());
+      return;
+   }
+
+   GetSrvRecords(Host, Port, Result);
+   std::string Records;
+   for (auto const &R : Result)
+   {
+      if (Records.empty() == false)
+	 Records.append(",");
+      Records.append(R.target).append("/").append(std::to_string(static_cast<unsigned int>(R.port))).append("/");
+      Records.append(std::to_string(static_cast<unsigned int>(R.priority))).append("/");
+      Records.append(std::to_string(static_cast<unsigned int>(R.weight)));
+   }
+   ShareResolverResult(CacheKey, Records, Host, Owner);
+}
+									/*}}}*/
 // Connect - Connect to a server					/*{{{*/
 // ---------------------------------------------------------------------
 /* Performs a connection to the server (including SRV record lookup) */
@@ -301,7 +596,7 @@ bool Connect(std::string Host,int Port,const char *Service,
       SrvRecords.clear();
       if (_config->FindB("Acquire::EnableSrvRecords", true) == true)
       {
-         GetSrvRecords(Host, DefPort, SrvRecords);
+         GetCachedSrvRecords(Host, DefPort, SrvRecords, Owner);
 	 // RFC2782 defines that a lonely '.' target is an abort reason
 	 if (SrvRecords.size() == 1 && SrvRecords[0].target.empty())
 	    return _error->Error("SRV records for %s indicate that "
@@ -340,3 +635,292 @@ bool Connect(std::string Host,int Port,const char *Service,
 	 _error->MergeWithStack();
    return ret;
 }
+									/*}}}*/
+// Connection pool - Keep idle connections open for later methods	/*{{{*/
+// ---------------------------------------------------------------------
+/* Instead of closing an idle keep-alive connection a method can hand it
+   over to a small helper process listening on a unix socket. A method
+   started later on (e.g. by the apt run following an update) asks the
+   helper for a connection to the same server and gets the still open
+   socket passed back, so that the connection setup is skipped. The helper
+   is forked off by the first method returning a connection and exits once
+   all connections it holds are closed by the servers or were idle for too
+   long. */
+#ifdef __linux__
+struct PooledConnection
+{
+   std::string Key;
+   int Fd;
+   time_t Since;
+};
+static socklen_t PoolAddress(struct sockaddr_un &Addr)
+{
+   memset(&Addr, 0, sizeof(Addr));
+   Addr.sun_family = AF_UNIX;
+   // an abstract socket, so that we don't need a directory writeable for us
+   int const Len = snprintf(Addr.sun_path + 1, sizeof(Addr.sun_path) - 1,
+	 "apt-connection-pool-%lu", static_cast<unsigned long>(getuid()));
+   return offsetof(struct sockaddr_un, sun_path) + 1 + Len;
+}
+static void PoolTimeout(int const Sock)
+{
+   struct timeval tv;
+   tv.tv_sec = 5;
+   tv.tv_usec = 0;
+   setsockopt(Sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   setsockopt(Sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+static int PoolConnect()
+{
+   struct sockaddr_un Addr;
+   socklen_t const Len = PoolAddress(Addr);
+   int const Sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if (Sock == -1)
+      return -1;
+   if (connect(Sock, reinterpret_cast<struct sockaddr *>(&Addr), Len) != 0)
+   {
+      close(Sock);
+      return -1;
+   }
+   PoolTimeout(Sock);
+   return Sock;
+}
+// PoolSend - Send a message (and a file descriptor) over the pool socket
+static bool PoolSend(int const Sock, std::string const &Message, int const Fd)
+{
+   struct iovec iov;
+   iov.iov_base = const_cast<char *>(Message.c_str());
+   iov.iov_len = Message.length();
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+   if (Fd != -1)
+   {
+      memset(&control, 0, sizeof(control));
+      msg.msg_control = control.buf;
+      msg.msg_controllen = sizeof(control.buf);
+      struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &Fd, sizeof(int));
+   }
+   return sendmsg(Sock, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(Message.length());
+}
+// PoolReceive - Receive a message (and a file descriptor) from the socket
+static bool PoolReceive(int const Sock, std::string &Message, int &Fd)
+{
+   Fd = -1;
+   char buf[1024];
+   struct iovec iov;
+   iov.iov_base = buf;
+   iov.iov_len = sizeof(buf);
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+   msg.msg_control = control.buf;
+   msg.msg_controllen = sizeof(control.buf);
+   ssize_t const Res = recvmsg(Sock, &msg, MSG_CMSG_CLOEXEC);
+   if (Res <= 0)
+      return false;
+   for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+	 memcpy(&Fd, CMSG_DATA(cmsg), sizeof(int));
+   Message.assign(buf, Res);
+   return true;
+}
+// PoolServe - The main loop of the helper process
+static void PoolServe(int const Listen, std::vector<PooledConnection> Pool,
+      unsigned long const IdleTime)
+{
+   while (Pool.empty() == false)
+   {
+      time_t const Now = time(NULL);
+      time_t Wait = IdleTime;
+      fd_set rfds;
+      FD_ZERO(&rfds);
+      FD_SET(Listen, &rfds);
+      int MaxFd = Listen;
+      for (auto C = Pool.begin(); C != Pool.end();)
+      {
+	 if (C->Since + static_cast<time_t>(IdleTime) <= Now || C->Fd >= FD_SETSIZE)
+	 {
+	    close(C->Fd);
+	    C = Pool.erase(C);
+	    continue;
+	 }
+	 Wait = std::min(Wait, C->Since + static_cast<time_t>(IdleTime) - Now);
+	 FD_SET(C->Fd, &rfds);
+	 MaxFd = std::max(MaxFd, C->Fd);
+	 ++C;
+      }
+      if (Pool.empty() == true)
+	 break;
+
+      struct timeval tv;
+      tv.tv_sec = Wait;
+      tv.tv_usec = 0;
+      if (select(MaxFd + 1, &rfds, NULL, NULL, &tv) < 0)
+      {
+	 if (errno == EINTR)
+	    continue;
+	 break;
+      }
+
+      // the server closed the connection (or sent garbage), it is unusable
+      for (auto C = Pool.begin(); C != Pool.end();)
+      {
+	 if (FD_ISSET(C->Fd, &rfds))
+	 {
+	    close(C->Fd);
+	    C = Pool.erase(C);
+	 }
+	 else
+	    ++C;
+      }
+      if (FD_ISSET(Listen, &rfds) == 0)
+	 continue;
+
+      int const Client = accept4(Listen, NULL, NULL, SOCK_CLOEXEC);
+      if (Client == -1)
+	 continue;
+      PoolTimeout(Client);
+      // only methods running as our user may use our connections
+      struct ucred Cred;
+      socklen_t CredLen = sizeof(Cred);
+      std::string Message;
+      int Fd = -1;
+      if (getsockopt(Client, SOL_SOCKET, SO_PEERCRED, &Cred, &CredLen) == 0 &&
+	    Cred.uid == getuid() && PoolReceive(Client, Message, Fd) == true)
+      {
+	 if (Message.compare(0, 4, "put ") == 0 && Fd != -1)
+	 {
+	    Pool.push_back({Message.substr(4), Fd, time(NULL)});
+	    Fd = -1;
+	 }
+	 else if (Message.compare(0, 4, "get ") == 0)
+	 {
+	    // the most recently used connection is the least likely to be closed
+	    auto const Key = Message.substr(4);
+	    auto const C = std::find_if(Pool.rbegin(), Pool.rend(),
+		  [&](PooledConnection const &P) { return P.Key == Key; });
+	    if (C == Pool.rend())
+	       PoolSend(Client, "none", -1);
+	    else
+	    {
+	       PoolSend(Client, "connection", C->Fd);
+	       close(C->Fd);
+	       Pool.erase(std::next(C).base());
+	    }
+	 }
+      }
+      if (Fd != -1)
+	 close(Fd);
+      close(Client);
+   }
+}
+// PoolSpawn - Start the helper process holding the given connection
+static bool PoolSpawn(std::string const &Key, int const Fd, unsigned long const IdleTime)
+{
+   struct sockaddr_un Addr;
+   socklen_t const Len = PoolAddress(Addr);
+   int const Listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if (Listen == -1)
+      return false;
+   if (bind(Listen, reinterpret_cast<struct sockaddr *>(&Addr), Len) != 0 ||
+	 listen(Listen, 16) != 0)
+   {
+      close(Listen);
+      return false;
+   }
+
+   pid_t const Process = fork();
+   if (Process == -1)
+   {
+      close(Listen);
+      return false;
+   }
+   if (Process == 0)
+   {
+      // detach from the method, so that nobody waits for the helper
+      setsid();
+      if (fork() != 0)
+	 _exit(0);
+      signal(SIGTERM, SIG_DFL);
+      signal(SIGINT, SIG_DFL);
+      signal(SIGPIPE, SIG_IGN);
+      if (chdir("/") != 0)
+	 _exit(0);
+      int const Null = open("/dev/null", O_RDWR);
+      if (Null == -1)
+	 _exit(0);
+      dup2(Null, STDIN_FILENO);
+      dup2(Null, STDOUT_FILENO);
+      dup2(Null, STDERR_FILENO);
+      for (int K = 3; K < sysconf(_SC_OPEN_MAX); ++K)
+	 if (K != Listen && K != Fd)
+	    close(K);
+      PoolServe(Listen, {{Key, Fd, time(NULL)}}, IdleTime);
+      _exit(0);
+   }
+   close(Listen);
+   waitpid(Process, NULL, 0);
+   return true;
+}
+#endif
+static std::string PoolKey(char const * const Service, std::string const &Host, int const Port)
+{
+   std::string Key;
+   strprintf(Key, "%s://%s:%d", Service, Host.c_str(), Port);
+   return Key;
+}
+// ConnectFromPool - Take over an idle connection from the pool
+bool ConnectFromPool(std::string const &Host, int const Port,
+      const char * const Service, int &Fd)
+{
+#ifdef __linux__
+   int const Sock = PoolConnect();
+   if (Sock == -1)
+      return false;
+   std::string Message;
+   int Connection = -1;
+   bool const Res = PoolSend(Sock, "get " + PoolKey(Service, Host, Port), -1) &&
+      PoolReceive(Sock, Message, Connection);
+   close(Sock);
+   if (Res == false || Connection == -1)
+      return false;
+   Fd = Connection;
+   return true;
+#else
+   return false;
+#endif
+}
+// ReturnToPool - Hand an idle connection over to the pool
+bool ReturnToPool(std::string const &Host, int const Port,
+      const char * const Service, int const Fd, unsigned long const IdleTime)
+{
+#ifdef __linux__
+   if (Fd == -1 || IdleTime == 0)
+      return false;
+   std::string const Key = PoolKey(Service, Host, Port);
+   int const Sock = PoolConnect();
+   if (Sock == -1)
+      return PoolSpawn(Key, Fd, IdleTime);
+   bool const Res = PoolSend(Sock, "put " + Key, Fd);
+   close(Sock);
+   return Res;
+#else
+   return false;
+#endif
+}
+									/*}}}*/
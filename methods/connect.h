@@ -17,5 +17,10 @@ class pkgAcqMethod;
 bool Connect(std::string To,int Port,const char *Service,int DefPort,
 	     int &Fd,unsigned long TimeOut,pkgAcqMethod *Owner);
 void RotateDNS();
+void AddResolverCache(std::string const &Entries);
+bool ConnectFromPool(std::string const &Host, int const Port,
+      const char * const Service, int &Fd);
+bool ReturnToPool(std::string const &Host, int const Port,
+      const char * const Service, int const Fd, unsigned long const IdleTime);
 
 #endif
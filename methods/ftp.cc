@@ -1005,6 +1005,13 @@ bool FtpMethod::Configuration(string Message)
    return true;
 }
 									/*}}}*/
+// FtpMethod::URIAcquire - Take over the resolver cache		/*{{{*/
+bool FtpMethod::URIAcquire(std::string const &Message, FetchItem *Itm)
+{
+   AddResolverCache(LookupTag(Message, "Resolver-Cache"));
+   return aptMethod::URIAcquire(Message, Itm);
+}
+									/*}}}*/
 // FtpMethod::Fetch - Fetch a file					/*{{{*/
 // ---------------------------------------------------------------------
 /* Fetch a single file, called by the base class..  */
@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -111,7 +112,7 @@ class GPGVMethod : public aptMethod
    protected:
    virtual bool URIAcquire(std::string const &Message, FetchItem *Itm) APT_OVERRIDE;
    public:
-   GPGVMethod() : aptMethod("gpgv","1.0",SingleInstance | SendConfig) {};
+   GPGVMethod() : aptMethod("gpgv","1.0",SendConfig) {};
 };
 static void PushEntryWithKeyID(std::vector<std::string> &Signers, char * const buffer, bool const Debug)
 {
@@ -375,9 +376,18 @@ bool GPGVMethod::URIAcquire(std::string const &Message, FetchItem *Itm)
    URIStart(Res);
 
    // Run apt-key on file, extract contents and get the key ID of the signer
+   struct timeval Start;
+   gettimeofday(&Start, NULL);
    string const msg = VerifyGetSigners(Path.c_str(), Itm->DestFile.c_str(), key,
                                  GoodSigners, BadSigners, WorthlessSigners,
                                  SoonWorthlessSigners, NoPubKeySigners);
+   if (DebugEnabled())
+   {
+      struct timeval Stop;
+      gettimeofday(&Stop, NULL);
+      double const Took = (Stop.tv_sec - Start.tv_sec) + (Stop.tv_usec - Start.tv_usec) / 1000000.0;
+      ioprintf(std::clog, "Verification of %s took %.3fs\n", Path.c_str(), Took);
+   }
    if (_error->PendingError())
       return false;
 
@@ -60,7 +60,64 @@ unsigned long long CircleBuf::BwReadLimit=0;
 unsigned long long CircleBuf::BwTickReadData=0;
 struct timeval CircleBuf::BwReadTick={0,0};
 const unsigned int CircleBuf::BW_HZ=10;
+bool CircleBuf::BwGranted=false;
 
+// ThreadedHashes::ThreadedHashes - Start the hashing thread		/*{{{*/
+ThreadedHashes::ThreadedHashes(Hashes * const Hash) : Hash(Hash), Busy(false), Done(false),
+   Thread(&ThreadedHashes::Run, this)
+{
+}
+									/*}}}*/
+// ThreadedHashes::Run - Hash the queued data until we are done		/*{{{*/
+void ThreadedHashes::Run()
+{
+   std::unique_lock<std::mutex> Guard(Lock);
+   while (true)
+   {
+      Wakeup.wait(Guard, [this]() { return Done == true || Pending.empty() == false; });
+      if (Pending.empty() == true)
+	 return;
+      std::vector<unsigned char> const Data = std::move(Pending.front());
+      Pending.pop_front();
+      Busy = true;
+      Guard.unlock();
+      Hash->Add(Data.data(), Data.size());
+      Guard.lock();
+      Busy = false;
+      Idle.notify_all();
+   }
+}
+									/*}}}*/
+// ThreadedHashes::Add - Queue data for hashing				/*{{{*/
+// ---------------------------------------------------------------------
+/* The amount of queued data is limited, so if hashing can't keep up the
+   download is slowed down instead of buffering the file in memory. */
+void ThreadedHashes::Add(unsigned char const * const Data, unsigned long long const Size)
+{
+   std::unique_lock<std::mutex> Guard(Lock);
+   Idle.wait(Guard, [this]() { return Pending.size() < 64; });
+   Pending.emplace_back(Data, Data + Size);
+   Wakeup.notify_one();
+}
+									/*}}}*/
+// ThreadedHashes::Finish - Wait for all queued data to be hashed	/*{{{*/
+void ThreadedHashes::Finish()
+{
+   std::unique_lock<std::mutex> Guard(Lock);
+   Idle.wait(Guard, [this]() { return Busy == false && Pending.empty() == true; });
+}
+									/*}}}*/
+// ThreadedHashes::~ThreadedHashes - Hash the rest and stop the thread	/*{{{*/
+ThreadedHashes::~ThreadedHashes()
+{
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Done = true;
+   }
+   Wakeup.notify_one();
+   Thread.join();
+}
+									/*}}}*/
 // CircleBuf::CircleBuf - Circular input buffer				/*{{{*/
 // ---------------------------------------------------------------------
 /* */
@@ -68,9 +125,29 @@ CircleBuf::CircleBuf(HttpMethod const * const Owner, unsigned long long Size)
    : Size(Size), Hash(NULL), TotalWriten(0)
 {
    Buf = new unsigned char[Size];
+   HashInThread = Owner->ConfigFindB("Hash-Thread", false);
    Reset();
 
    CircleBuf::BwReadLimit = Owner->ConfigFindI("Dl-Limit", 0) * 1024;
+   CircleBuf::BwGranted = _config->FindI("Acquire::Dl-Limit", 0) > 0;
+}
+									/*}}}*/
+// CircleBuf::InitHashes - Start hashing the data written out		/*{{{*/
+void CircleBuf::InitHashes(HashStringList const &ExpectedHashes)
+{
+   HashThread.reset();
+   delete Hash;
+   Hash = new Hashes(ExpectedHashes);
+   if (HashInThread == true)
+      HashThread.reset(new ThreadedHashes(Hash));
+}
+									/*}}}*/
+// CircleBuf::GetHashes - Hashes of all data written out so far		/*{{{*/
+Hashes * CircleBuf::GetHashes()
+{
+   if (HashThread != nullptr)
+      HashThread->Finish();
+   return Hash;
 }
 									/*}}}*/
 // CircleBuf::Reset - Reset to the default state			/*{{{*/
@@ -84,6 +161,7 @@ void CircleBuf::Reset()
    TotalWriten = 0;
    MaxGet = (unsigned long long)-1;
    OutQueue = string();
+   HashThread.reset();
    if (Hash != NULL)
    {
       delete Hash;
@@ -103,6 +181,10 @@ bool CircleBuf::Read(int Fd)
       if (InP - OutP == Size)
 	 return true;
 
+      // Wait for apt to grant us more of the total bandwidth
+      if (HaveBudget() == false)
+	 return true;
+
       // what's left to read in this tick
       unsigned long long const BwReadMax = CircleBuf::BwReadLimit/BW_HZ;
 
@@ -124,15 +206,17 @@ bool CircleBuf::Read(int Fd)
       }
 
       // Write the buffer segment
-      ssize_t Res;
-      if(CircleBuf::BwReadLimit) {
-	 Res = read(Fd,Buf + (InP%Size), 
-		    BwReadMax > LeftRead() ? LeftRead() : BwReadMax);
-      } else
-	 Res = read(Fd,Buf + (InP%Size),LeftRead());
+      unsigned long long ReadMax = LeftRead();
+      if(CircleBuf::BwReadLimit && BwReadMax < ReadMax)
+	 ReadMax = BwReadMax;
+      if (CircleBuf::BwGranted && pkgAcqMethod::GrantedBandwidth() < ReadMax)
+	 ReadMax = pkgAcqMethod::GrantedBandwidth();
+      ssize_t Res = read(Fd,Buf + (InP%Size),ReadMax);
       
       if(Res > 0 && BwReadLimit > 0) 
 	 CircleBuf::BwTickReadData += Res;
+      if (Res > 0 && BwGranted == true)
+	 pkgAcqMethod::UseBandwidth(Res);
     
       if (Res == 0)
 	 return false;
@@ -222,7 +306,9 @@ bool CircleBuf::Write(int Fd)
 
       TotalWriten += Res;
       
-      if (Hash != NULL)
+      if (HashThread != nullptr)
+	 HashThread->Add(Buf + (OutP%Size),Res);
+      else if (Hash != NULL)
 	 Hash->Add(Buf + (OutP%Size),Res);
       
       OutP += Res;
@@ -283,12 +369,13 @@ void CircleBuf::Stats()
 									/*}}}*/
 CircleBuf::~CircleBuf()
 {
+   HashThread.reset();
    delete [] Buf;
    delete Hash;
 }
 
 // HttpServerState::HttpServerState - Constructor			/*{{{*/
-HttpServerState::HttpServerState(URI Srv,HttpMethod *Owner) : ServerState(Srv, Owner), In(Owner, 64*1024), Out(Owner, 4*1024)
+HttpServerState::HttpServerState(URI Srv,HttpMethod *Owner) : ServerState(Srv, Owner), In(Owner, 64*1024), Out(Owner, 4*1024), PoolPort(0)
 {
    TimeOut = Owner->ConfigFindI("Timeout", TimeOut);
    Reset();
@@ -539,6 +626,18 @@ bool HttpServerState::Open()
 	    Port = Proxy.Port;
 	 Host = Proxy.Host;
       }
+      PoolHost.clear();
+      if (Owner->ConfigFindI("Connection-Pool", 0) > 0)
+      {
+	 PoolHost = Host;
+	 PoolPort = Port;
+	 if (ConnectFromPool(Host, Port, "http", ServerFd) == true)
+	 {
+	    if (Owner->DebugEnabled())
+	       ioprintf(std::clog, "http: reusing a pooled connection to %s:%d\n", Host.c_str(), Port);
+	    return true;
+	 }
+      }
       return Connect(Host,Port,"http",80,ServerFd,TimeOut,Owner);
    }
    return true;
@@ -554,6 +653,25 @@ bool HttpServerState::Close()
    return true;
 }
 									/*}}}*/
+// HttpServerState::Park - Hand an idle connection over to the pool	/*{{{*/
+// ---------------------------------------------------------------------
+/* Only connections which have nothing left to send or receive can be
+   picked up by another method later on. If the pool doesn't take the
+   connection it is kept open, so that keep-alive works as usual. */
+bool HttpServerState::Park()
+{
+   unsigned long const IdleTime = Owner->ConfigFindI("Connection-Pool", 0);
+   if (ServerFd == -1 || PoolHost.empty() == true || IdleTime == 0 ||
+	 Persistent == false || In.WriteSpace() == true || Out.WriteSpace() == true)
+      return true;
+   if (ReturnToPool(PoolHost, PoolPort, "http", ServerFd, IdleTime) == false)
+      return true;
+   if (Owner->DebugEnabled())
+      ioprintf(std::clog, "http: connection to %s:%d kept in the pool\n", PoolHost.c_str(), PoolPort);
+   // the pool has its own copy of the connection now
+   return Close();
+}
+									/*}}}*/
 // HttpServerState::RunData - Transfer the data from the socket		/*{{{*/
 bool HttpServerState::RunData(FileFd * const File)
 {
@@ -677,8 +795,7 @@ APT_PURE bool HttpServerState::IsOpen()					/*{{{*/
 									/*}}}*/
 bool HttpServerState::InitHashes(HashStringList const &ExpectedHashes)	/*{{{*/
 {
-   delete In.Hash;
-   In.Hash = new Hashes(ExpectedHashes);
+   In.InitHashes(ExpectedHashes);
    return true;
 }
 									/*}}}*/
@@ -690,9 +807,9 @@ void HttpServerState::Reset(bool const Everything)			/*{{{*/
 }
 									/*}}}*/
 
-APT_PURE Hashes * HttpServerState::GetHashes()				/*{{{*/
+Hashes * HttpServerState::GetHashes()					/*{{{*/
 {
-   return In.Hash;
+   return In.GetHashes();
 }
 									/*}}}*/
 // HttpServerState::Die - The server has closed the connection.		/*{{{*/
@@ -795,7 +912,7 @@ bool HttpServerState::Go(bool ToFile, FileFd * const File)
    if (Out.WriteSpace() == true && ServerFd != -1 
        && Persistent == true)
       FD_SET(ServerFd,&wfds);
-   if (In.ReadSpace() == true && ServerFd != -1)
+   if (In.ReadSpace() == true && ServerFd != -1 && CircleBuf::HaveBudget() == true)
       FD_SET(ServerFd,&rfds);
    
    // Add the file
@@ -806,8 +923,8 @@ bool HttpServerState::Go(bool ToFile, FileFd * const File)
    if (In.WriteSpace() == true && ToFile == true && FileFD != -1)
       FD_SET(FileFD,&wfds);
 
-   // Add stdin
-   if (Owner->ConfigFindB("DependOnSTDIN", true) == true)
+   // Add stdin, which is also where new bandwidth grants come from
+   if (Owner->ConfigFindB("DependOnSTDIN", true) == true || CircleBuf::HaveBudget() == false)
       FD_SET(STDIN_FILENO,&rfds);
 	  
    // Figure out the max fd
@@ -978,6 +1095,12 @@ void HttpMethod::RotateDNS()						/*{{{*/
    ::RotateDNS();
 }
 									/*}}}*/
+bool HttpMethod::URIAcquire(std::string const &Message, FetchItem *Itm)/*{{{*/
+{
+   AddResolverCache(LookupTag(Message, "Resolver-Cache"));
+   return ServerMethod::URIAcquire(Message, Itm);
+}
+									/*}}}*/
 ServerMethod::DealWithHeadersResult HttpMethod::DealWithHeaders(FetchResult &Res)/*{{{*/
 {
    auto ret = ServerMethod::DealWithHeaders(Res);
@@ -1007,7 +1130,7 @@ ServerMethod::DealWithHeadersResult HttpMethod::DealWithHeaders(FetchResult &Res
    return FILE_IS_OPEN;
 }
 									/*}}}*/
-HttpMethod::HttpMethod(std::string &&pProg) : ServerMethod(pProg.c_str(), "1.2", Pipeline | SendConfig)/*{{{*/
+HttpMethod::HttpMethod(std::string &&pProg) : ServerMethod(pProg.c_str(), "1.2", Pipeline | SendConfig | BandwidthGrants)/*{{{*/
 {
    auto addName = std::inserter(methodNames, methodNames.begin());
    if (Binary != "http")
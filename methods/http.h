@@ -13,9 +13,15 @@
 
 #include <apt-pkg/strutl.h>
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <sys/time.h>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include "server.h"
 
@@ -26,6 +32,34 @@ class FileFd;
 class HttpMethod;
 class Hashes;
 
+/** \brief feeds the data given to it into a Hashes object on its own thread
+ *
+ *  Calculating all the hashes of a file is expensive enough to limit the
+ *  download rate if it is done on the thread also handling the socket.
+ */
+class ThreadedHashes
+{
+   Hashes * const Hash;
+   std::deque<std::vector<unsigned char>> Pending;
+   bool Busy;
+   bool Done;
+   std::mutex Lock;
+   std::condition_variable Wakeup;
+   std::condition_variable Idle;
+   std::thread Thread;
+
+   void Run();
+
+   public:
+   /** \brief queue a copy of the given data for hashing */
+   void Add(unsigned char const * const Data, unsigned long long const Size);
+   /** \brief wait until all queued data was added to the hashes */
+   void Finish();
+
+   explicit ThreadedHashes(Hashes * const Hash);
+   ~ThreadedHashes();
+};
+
 class CircleBuf
 {
    unsigned char *Buf;
@@ -41,6 +75,10 @@ class CircleBuf
    static unsigned long long BwTickReadData;
    static struct timeval BwReadTick;
    static const unsigned int BW_HZ;
+   static bool BwGranted;
+
+   bool HashInThread;
+   std::unique_ptr<ThreadedHashes> HashThread;
 
    unsigned long long LeftRead() const
    {
@@ -78,10 +116,17 @@ class CircleBuf
    bool IsLimit() const {return MaxGet == OutP;};
    void Print() const {cout << MaxGet << ',' << OutP << endl;};
 
+   // Control the data we may read with Acquire::Dl-Limit
+   static bool HaveBudget() {return BwGranted == false || pkgAcqMethod::GrantedBandwidth() != 0;};
+
    // Test for free space in the buffer
    bool ReadSpace() const {return Size - (InP - OutP) > 0;};
    bool WriteSpace() const {return InP - OutP > 0;};
 
+   // Calculate the hashes of all data written out
+   void InitHashes(HashStringList const &ExpectedHashes);
+   Hashes * GetHashes();
+
    void Reset();
    // Dump everything
    void Stats();
@@ -96,6 +141,9 @@ struct HttpServerState: public ServerState
    CircleBuf In;
    CircleBuf Out;
    int ServerFd;
+   // the server (or proxy) ServerFd is connected to for the connection pool
+   std::string PoolHost;
+   int PoolPort;
 
    protected:
    virtual bool ReadHeaderLines(std::string &Data) APT_OVERRIDE;
@@ -111,6 +159,7 @@ struct HttpServerState: public ServerState
    virtual bool Open() APT_OVERRIDE;
    virtual bool IsOpen() APT_OVERRIDE;
    virtual bool Close() APT_OVERRIDE;
+   virtual bool Park() APT_OVERRIDE;
    virtual bool InitHashes(HashStringList const &ExpectedHashes) APT_OVERRIDE;
    virtual Hashes * GetHashes() APT_OVERRIDE;
    virtual bool Die(FileFd * const File) APT_OVERRIDE;
@@ -128,6 +177,7 @@ class HttpMethod : public ServerMethod
 
    virtual std::unique_ptr<ServerState> CreateServerState(URI const &uri) APT_OVERRIDE;
    virtual void RotateDNS() APT_OVERRIDE;
+   virtual bool URIAcquire(std::string const &Message, FetchItem *Itm) APT_OVERRIDE;
    virtual DealWithHeadersResult DealWithHeaders(FetchResult &Res) APT_OVERRIDE;
 
    protected:
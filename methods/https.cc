@@ -346,8 +346,11 @@ bool HttpsMethod::Fetch(FetchItem *Itm)
       headers = curl_slist_append(headers, "Pragma: no-cache");
    }
    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-   // speed limit
-   int const dlLimit = ConfigFindI("Dl-Limit", 0) * 1024;
+   // speed limit, we can't take grants, so Acquire::Dl-Limit is applied here
+   int dlLimit = ConfigFindI("Dl-Limit", 0) * 1024;
+   int const totalLimit = _config->FindI("Acquire::Dl-Limit", 0) * 1024;
+   if (totalLimit > 0 && (dlLimit <= 0 || totalLimit < dlLimit))
+      dlLimit = totalLimit;
    if (dlLimit > 0)
       curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, dlLimit);
 
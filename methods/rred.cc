@@ -18,7 +18,9 @@
 #include <stddef.h>
 #include <iostream>
 #include <string>
-#include <list>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <vector>
 
 #include <assert.h>
@@ -148,18 +150,158 @@ struct Change {
 };
 
 class FileChanges {
-   std::list<struct Change> changes;
-   std::list<struct Change>::iterator where;
-   size_t pos; // line number is as far left of iterator as possible
+   /* The changes are kept in a treap ordered by their position in the file.
+      Every node knows how many lines of the patched file its subtree covers
+      (offset + add_cnt of all its changes), so the change responsible for
+      a given line can be found in O(log n) instead of walking through all
+      changes in between, which made merging long patch chains quadratic. */
+   struct Node {
+      Change change;
+      Node *left;
+      Node *right;
+      Node *parent;
+      unsigned int priority;
+      size_t lines; // lines covered by this subtree
+
+      Node(Change const &c, unsigned int const prio) : change(c), left(NULL),
+	 right(NULL), parent(NULL), priority(prio), lines(c.offset + c.add_cnt) {}
+   };
+
+   Node *root;
+   Node *where; // NULL is the end
+   size_t pos; // line number is as far left of where as possible
+   unsigned int seed;
+
+   static size_t lines_of(Node const * const n) { return n == NULL ? 0 : n->lines; }
+   static void recount(Node * const n)
+   {
+      n->lines = lines_of(n->left) + n->change.offset + n->change.add_cnt + lines_of(n->right);
+   }
+   static void recount_upwards(Node *n)
+   {
+      for (; n != NULL; n = n->parent)
+	 recount(n);
+   }
+   static Node *leftmost(Node *n)
+   {
+      if (n != NULL)
+	 for (; n->left != NULL; n = n->left);
+      return n;
+   }
+   static Node *rightmost(Node *n)
+   {
+      if (n != NULL)
+	 for (; n->right != NULL; n = n->right);
+      return n;
+   }
+   static Node *next(Node *n)
+   {
+      if (n->right != NULL)
+	 return leftmost(n->right);
+      for (; n->parent != NULL && n->parent->right == n; n = n->parent);
+      return n->parent;
+   }
+   Node *prev(Node *n) const
+   {
+      if (n == NULL)
+	 return rightmost(root);
+      if (n->left != NULL)
+	 return rightmost(n->left);
+      for (; n->parent != NULL && n->parent->left == n; n = n->parent);
+      return n->parent;
+   }
+
+   void replace_child(Node * const parent, Node * const old, Node * const n)
+   {
+      if (parent == NULL)
+	 root = n;
+      else if (parent->left == old)
+	 parent->left = n;
+      else
+	 parent->right = n;
+      if (n != NULL)
+	 n->parent = parent;
+   }
+   /* move the child c of n one level up, keeping the order intact */
+   void rotate_up(Node * const c)
+   {
+      Node * const n = c->parent;
+      replace_child(n->parent, n, c);
+      if (n->left == c)
+      {
+	 n->left = c->right;
+	 if (n->left != NULL)
+	    n->left->parent = n;
+	 c->right = n;
+      }
+      else
+      {
+	 n->right = c->left;
+	 if (n->right != NULL)
+	    n->right->parent = n;
+	 c->left = n;
+      }
+      n->parent = c;
+      recount(n);
+      recount(c);
+   }
+
+   /* insert c directly in front of before (NULL is the end) */
+   Node *insert_before(Node * const before, Change const &c)
+   {
+      seed = seed * 1103515245 + 12345;
+      Node * const n = new Node(c, seed);
+      if (root == NULL)
+	 root = n;
+      else if (before == NULL)
+      {
+	 Node * const last = rightmost(root);
+	 last->right = n;
+	 n->parent = last;
+      }
+      else if (before->left == NULL)
+      {
+	 before->left = n;
+	 n->parent = before;
+      }
+      else
+      {
+	 Node * const last = rightmost(before->left);
+	 last->right = n;
+	 n->parent = last;
+      }
+      recount_upwards(n->parent);
+      while (n->parent != NULL && n->parent->priority < n->priority)
+	 rotate_up(n);
+      return n;
+   }
+
+   void erase(Node * const n)
+   {
+      while (n->left != NULL && n->right != NULL)
+	 rotate_up((n->left->priority > n->right->priority) ? n->left : n->right);
+      Node * const parent = n->parent;
+      replace_child(parent, n, (n->left != NULL) ? n->left : n->right);
+      recount_upwards(parent);
+      delete n;
+   }
+
+   static void destroy(Node * const n)
+   {
+      if (n == NULL)
+	 return;
+      destroy(n->left);
+      destroy(n->right);
+      delete n;
+   }
 
    bool pos_is_okay(void) const
    {
 #ifdef POSDEBUG
       size_t cpos = 0;
-      std::list<struct Change>::const_iterator x;
-      for (x = changes.begin(); x != where; ++x) {
-	 assert(x != changes.end());
-	 cpos += x->offset + x->add_cnt;
+      for (Node *x = leftmost(root); x != where; x = next(x)) {
+	 assert(x != NULL);
+	 cpos += x->change.offset + x->change.add_cnt;
       }
       return cpos == pos;
 #else
@@ -168,33 +310,49 @@ class FileChanges {
    }
 
    public:
-   FileChanges() {
-      where = changes.end();
-      pos = 0;
-   }
-
-   std::list<struct Change>::iterator begin(void) { return changes.begin(); }
-   std::list<struct Change>::iterator end(void) { return changes.end(); }
-
-   std::list<struct Change>::reverse_iterator rbegin(void) { return changes.rbegin(); }
-   std::list<struct Change>::reverse_iterator rend(void) { return changes.rend(); }
+   class iterator : public std::iterator<std::bidirectional_iterator_tag, Change>
+   {
+      FileChanges const *owner;
+      Node *n;
+      public:
+      iterator(FileChanges const * const owner, Node * const n) : owner(owner), n(n) {}
+      Change &operator*() const { return n->change; }
+      Change *operator->() const { return &n->change; }
+      iterator &operator++() { n = next(n); return *this; }
+      iterator &operator--() { n = owner->prev(n); return *this; }
+      iterator operator++(int) { iterator old = *this; ++*this; return old; }
+      iterator operator--(int) { iterator old = *this; --*this; return old; }
+      bool operator==(iterator const &o) const { return n == o.n; }
+      bool operator!=(iterator const &o) const { return n != o.n; }
+   };
+   typedef std::reverse_iterator<iterator> reverse_iterator;
+
+   FileChanges() : root(NULL), where(NULL), pos(0), seed(42) {}
+   ~FileChanges() { destroy(root); }
+
+   iterator begin(void) { return iterator(this, leftmost(root)); }
+   iterator end(void) { return iterator(this, NULL); }
+
+   reverse_iterator rbegin(void) { return reverse_iterator(end()); }
+   reverse_iterator rend(void) { return reverse_iterator(begin()); }
 
    void add_change(Change c) {
       assert(pos_is_okay());
       go_to_change_for(c.offset);
-      assert(pos + where->offset == c.offset);
+      assert(pos + where->change.offset == c.offset);
       if (c.del_cnt > 0)
 	 delete_lines(c.del_cnt);
-      assert(pos + where->offset == c.offset);
+      assert(pos + where->change.offset == c.offset);
       if (c.add_len > 0) {
 	 assert(pos_is_okay());
-	 if (where->add_len > 0)
+	 if (where->change.add_len > 0)
 	    new_change();
-	 assert(where->add_len == 0 && where->add_cnt == 0);
+	 assert(where->change.add_len == 0 && where->change.add_cnt == 0);
 
-	 where->add_len = c.add_len;
-	 where->add_cnt = c.add_cnt;
-	 where->add = c.add;
+	 where->change.add_len = c.add_len;
+	 where->change.add_cnt = c.add_cnt;
+	 where->change.add = c.add;
+	 recount_upwards(where);
       }
       assert(pos_is_okay());
       merge();
@@ -204,64 +362,81 @@ class FileChanges {
    private:
    void merge(void)
    {
-      while (where->offset == 0 && where != changes.begin()) {
+      while (where->change.offset == 0 && where != leftmost(root)) {
 	 left();
       }
-      std::list<struct Change>::iterator next = where;
-      ++next;
-
-      while (next != changes.end() && next->offset == 0) {
-	 where->del_cnt += next->del_cnt;
-	 next->del_cnt = 0;
-	 if (next->add == NULL) {
-	    next = changes.erase(next);
-	 } else if (where->add == NULL) {
-	    where->add = next->add;
-	    where->add_len = next->add_len;
-	    where->add_cnt = next->add_cnt;
-	    next = changes.erase(next);
+      Node *n = next(where);
+
+      while (n != NULL && n->change.offset == 0) {
+	 where->change.del_cnt += n->change.del_cnt;
+	 n->change.del_cnt = 0;
+	 if (n->change.add == NULL) {
+	    Node * const following = next(n);
+	    erase(n);
+	    n = following;
+	 } else if (where->change.add == NULL) {
+	    where->change.add = n->change.add;
+	    where->change.add_len = n->change.add_len;
+	    where->change.add_cnt = n->change.add_cnt;
+	    recount_upwards(where);
+	    Node * const following = next(n);
+	    erase(n);
+	    n = following;
 	 } else {
-	    ++next;
+	    n = next(n);
 	 }
       }
    }
 
    void go_to_change_for(size_t line)
    {
-      while(where != changes.end()) {
-	 if (line < pos) {
-	    left();
-	    continue;
-	 }
-	 if (pos + where->offset + where->add_cnt <= line) {
-	    right();
-	    continue;
-	 }
-	 // line is somewhere in this slot
-	 if (line < pos + where->offset) {
+      /* find the change covering this line: the first one whose lines
+	 reach beyond it */
+      Node *n = root;
+      where = NULL;
+      pos = 0;
+      size_t skipped = 0;
+      while (n != NULL) {
+	 size_t const before = skipped + lines_of(n->left);
+	 if (line < before)
+	    n = n->left;
+	 else if (line < before + n->change.offset + n->change.add_cnt) {
+	    where = n;
+	    pos = before;
 	    break;
-	 } else if (line == pos + where->offset) {
-	    return;
 	 } else {
-	    split(line - pos);
-	    right();
-	    return;
+	    skipped = before + n->change.offset + n->change.add_cnt;
+	    n = n->right;
 	 }
       }
-      /* it goes before this patch */
+      if (where == NULL)
+	 pos = lines_of(root);
+      else if (line < pos + where->change.offset) {
+	 insert(line - pos);
+	 return;
+      } else if (line == pos + where->change.offset) {
+	 return;
+      } else {
+	 split(line - pos);
+	 right();
+	 return;
+      }
+      /* it goes after all changes */
       insert(line-pos);
    }
 
-   void new_change(void) { insert(where->offset); }
+   void new_change(void) { insert(where->change.offset); }
 
    void insert(size_t offset)
    {
       assert(pos_is_okay());
-      assert(where == changes.end() || offset <= where->offset);
-      if (where != changes.end())
-	 where->offset -= offset;
-      changes.insert(where, Change(offset));
-      --where;
+      assert(where == NULL || offset <= where->change.offset);
+      if (where != NULL)
+      {
+	 where->change.offset -= offset;
+	 recount_upwards(where);
+      }
+      where = insert_before(where, Change(offset));
       assert(pos_is_okay());
    }
 
@@ -269,48 +444,50 @@ class FileChanges {
    {
       assert(pos_is_okay());
 
-      assert(where->offset < offset);
-      assert(offset < where->offset + where->add_cnt);
+      assert(where->change.offset < offset);
+      assert(offset < where->change.offset + where->change.add_cnt);
 
-      size_t keep_lines = offset - where->offset;
+      size_t keep_lines = offset - where->change.offset;
 
-      Change before(*where);
+      Change before(where->change);
 
-      where->del_cnt = 0;
-      where->offset = 0;
-      where->skip_lines(keep_lines);
+      where->change.del_cnt = 0;
+      where->change.offset = 0;
+      where->change.skip_lines(keep_lines);
+      recount_upwards(where);
 
       before.add_cnt = keep_lines;
-      before.add_len -= where->add_len;
+      before.add_len -= where->change.add_len;
 
-      changes.insert(where, before);
-      --where;
+      where = insert_before(where, before);
       assert(pos_is_okay());
    }
 
    void delete_lines(size_t cnt)
    {
-      std::list<struct Change>::iterator x = where;
+      Node *x = where;
       assert(pos_is_okay());
       while (cnt > 0)
       {
 	 size_t del;
-	 del = x->add_cnt;
+	 del = x->change.add_cnt;
 	 if (del > cnt)
 	    del = cnt;
-	 x->skip_lines(del);
+	 x->change.skip_lines(del);
+	 recount_upwards(x);
 	 cnt -= del;
 
-	 ++x;
-	 if (x == changes.end()) {
+	 x = next(x);
+	 if (x == NULL) {
 	    del = cnt;
 	 } else {
-	    del = x->offset;
+	    del = x->change.offset;
 	    if (del > cnt)
 	       del = cnt;
-	    x->offset -= del;
+	    x->change.offset -= del;
+	    recount_upwards(x);
 	 }
-	 where->del_cnt += del;
+	 where->change.del_cnt += del;
 	 cnt -= del;
       }
       assert(pos_is_okay());
@@ -318,19 +495,85 @@ class FileChanges {
 
    void left(void) {
       assert(pos_is_okay());
-      --where;
-      pos -= where->offset + where->add_cnt;
+      where = prev(where);
+      pos -= where->change.offset + where->change.add_cnt;
       assert(pos_is_okay());
    }
 
    void right(void) {
       assert(pos_is_okay());
-      pos += where->offset + where->add_cnt;
-      ++where;
+      pos += where->change.offset + where->change.add_cnt;
+      where = next(where);
       assert(pos_is_okay());
    }
 };
 
+class InputFile {
+   /* Reads the file to be patched in big blocks and passes on whole runs of
+      lines at once, so that the unchanged parts of the file are copied
+      (and hashed) with a few large writes instead of line by line. */
+   FileFd &f;
+   Hashes * const start_hash;
+   std::unique_ptr<char[]> buffer;
+   size_t pos;
+   size_t len;
+
+   bool fill(void)
+   {
+      unsigned long long actual = 0;
+      if (f.Read(buffer.get(), BLOCK_SIZE, &actual) == false || actual == 0)
+	 return false;
+      pos = 0;
+      len = actual;
+      return true;
+   }
+
+   /* pass on <lines> lines (or all remaining data) to <out> if given,
+      fails only if writing to <out> failed */
+   bool forward(size_t lines, FileFd * const out, Hashes * const end_hash)
+   {
+      while (lines > 0)
+      {
+	 if (pos == len && fill() == false)
+	    return true;
+	 char * const start = buffer.get() + pos;
+	 char * const stop = buffer.get() + len;
+	 char *p = start;
+	 while (lines > 0)
+	 {
+	    char * const nl = static_cast<char *>(memchr(p, '\n', stop - p));
+	    if (nl == NULL)
+	    {
+	       p = stop;
+	       break;
+	    }
+	    p = nl + 1;
+	    --lines;
+	 }
+	 size_t const l = p - start;
+	 if (start_hash)
+	    start_hash->Add(reinterpret_cast<unsigned char *>(start), l);
+	 if (out != nullptr)
+	 {
+	    if (out->Write(start, l) == false)
+	       return false;
+	    if (end_hash)
+	       end_hash->Add(reinterpret_cast<unsigned char *>(start), l);
+	 }
+	 pos += l;
+      }
+      return true;
+   }
+
+   public:
+   InputFile(FileFd &f, Hashes * const start_hash) : f(f), start_hash(start_hash),
+      buffer(new char[BLOCK_SIZE]), pos(0), len(0) {}
+
+   bool dump_lines(FileFd &o, size_t n, Hashes * const end_hash) { return forward(n, &o, end_hash); }
+   void skip_lines(size_t n) { forward(n, nullptr, nullptr); }
+   bool dump_rest(FileFd &o, Hashes * const end_hash) { return forward(std::numeric_limits<size_t>::max(), &o, end_hash); }
+};
+
 class Patch {
    FileChanges filechanges;
    MemBlock add_text;
@@ -346,47 +589,8 @@ class Patch {
       return true;
    }
 
-   static void dump_rest(FileFd &o, FileFd &i,
-	 Hashes * const start_hash, Hashes * const end_hash)
-   {
-      char buffer[BLOCK_SIZE];
-      unsigned long long l = 0;
-      while (i.Read(buffer, sizeof(buffer), &l)) {
-	 if (l ==0  || !retry_fwrite(buffer, l, o, start_hash, end_hash))
-	    break;
-      }
-   }
-
-   static void dump_lines(FileFd &o, FileFd &i, size_t n,
-	 Hashes * const start_hash, Hashes * const end_hash)
-   {
-      char buffer[BLOCK_SIZE];
-      while (n > 0) {
-	 if (i.ReadLine(buffer, sizeof(buffer)) == NULL)
-	    buffer[0] = '\0';
-	 size_t const l = strlen(buffer);
-	 if (l == 0 || buffer[l-1] == '\n')
-	    n--;
-	 retry_fwrite(buffer, l, o, start_hash, end_hash);
-      }
-   }
-
-   static void skip_lines(FileFd &i, int n, Hashes * const start_hash)
-   {
-      char buffer[BLOCK_SIZE];
-      while (n > 0) {
-	 if (i.ReadLine(buffer, sizeof(buffer)) == NULL)
-	    buffer[0] = '\0';
-	 size_t const l = strlen(buffer);
-	 if (l == 0 || buffer[l-1] == '\n')
-	    n--;
-	 if (start_hash)
-	    start_hash->Add((unsigned char*)buffer, l);
-      }
-   }
-
-   static void dump_mem(FileFd &o, char *p, size_t s, Hashes *hash) APT_NONNULL(2) {
-      retry_fwrite(p, s, o, nullptr, hash);
+   static bool dump_mem(FileFd &o, char *p, size_t s, Hashes *hash) APT_NONNULL(2) {
+      return retry_fwrite(p, s, o, nullptr, hash);
    }
 
    public:
@@ -488,13 +692,12 @@ class Patch {
    void write_diff(FileFd &f)
    {
       unsigned long long line = 0;
-      std::list<struct Change>::reverse_iterator ch;
-      for (ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
+      for (FileChanges::reverse_iterator ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
 	 line += ch->offset + ch->del_cnt;
       }
 
-      for (ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
-	 std::list<struct Change>::reverse_iterator mg_i, mg_e = ch;
+      for (FileChanges::reverse_iterator ch = filechanges.rbegin(); ch != filechanges.rend(); ++ch) {
+	 FileChanges::reverse_iterator const mg_e = ch;
 	 while (ch->del_cnt == 0 && ch->offset == 0)
 	 {
 	    ++ch;
@@ -513,10 +716,11 @@ class Patch {
 	    }
 	    f.Write(buf.c_str(), buf.length());
 
-	    mg_i = ch;
-	    do {
+	    for (FileChanges::reverse_iterator mg_i = ch;; --mg_i) {
 	       dump_mem(f, mg_i->add, mg_i->add_len, NULL);
-	    } while (mg_i-- != mg_e);
+	       if (mg_i == mg_e)
+		  break;
+	    }
 
 	    buf = ".\n";
 	    f.Write(buf.c_str(), buf.length());
@@ -531,18 +735,20 @@ class Patch {
       }
    }
 
-   void apply_against_file(FileFd &out, FileFd &in,
+   bool apply_against_file(FileFd &out, FileFd &in,
 	 Hashes * const start_hash = nullptr, Hashes * const end_hash = nullptr)
    {
-      std::list<struct Change>::iterator ch;
-      for (ch = filechanges.begin(); ch != filechanges.end(); ++ch) {
-	 dump_lines(out, in, ch->offset, start_hash, end_hash);
-	 skip_lines(in, ch->del_cnt, start_hash);
-	 if (ch->add_len != 0)
-	    dump_mem(out, ch->add, ch->add_len, end_hash);
+      InputFile input(in, start_hash);
+      for (FileChanges::iterator ch = filechanges.begin(); ch != filechanges.end(); ++ch) {
+	 if (input.dump_lines(out, ch->offset, end_hash) == false)
+	    return false;
+	 input.skip_lines(ch->del_cnt);
+	 if (ch->add_len != 0 && dump_mem(out, ch->add, ch->add_len, end_hash) == false)
+	    return false;
       }
-      dump_rest(out, in, start_hash, end_hash);
-      out.Flush();
+      if (input.dump_rest(out, end_hash) == false)
+	 return false;
+      return out.Flush();
    }
 };
 
@@ -675,12 +881,13 @@ class RredMethod : public aptMethod {
 	 if (StartHashes.usable())
 	 {
 	    Hashes start_hash(StartHashes);
-	    patch.apply_against_file(out, inp, &start_hash, &end_hash);
-	    if (start_hash.GetHashStringList() != StartHashes)
+	    if (patch.apply_against_file(out, inp, &start_hash, &end_hash) == false)
+	       _error->Error("Failed to write patched file %s", Itm->DestFile.c_str());
+	    else if (start_hash.GetHashStringList() != StartHashes)
 	       _error->Error("The input file hadn't the expected hash!");
 	 }
-	 else
-	    patch.apply_against_file(out, inp, nullptr, &end_hash);
+	 else if (patch.apply_against_file(out, inp, nullptr, &end_hash) == false)
+	    _error->Error("Failed to write patched file %s", Itm->DestFile.c_str());
 
 	 out.Close();
 	 inp.Close();
@@ -764,19 +971,25 @@ int main(int argc, char **argv)
       std::cerr << "Patching " << argv[2] << " into " << argv[3] << "\n";
       inp.Open(argv[2], FileFd::ReadOnly,FileFd::Extension);
       out.Open(argv[3], FileFd::WriteOnly | FileFd::Create | FileFd::Empty | FileFd::BufferedWrite, FileFd::Extension);
-      patch.apply_against_file(out, inp);
-      out.Close();
+      if (patch.apply_against_file(out, inp) == false || out.Close() == false)
+      {
+	 _error->DumpErrors(std::cerr);
+	 exit(3);
+      }
    } else if (just_diff) {
       FileFd out;
-      out.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly | FileFd::Create);
+      out.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly | FileFd::Create | FileFd::BufferedWrite);
       patch.write_diff(out);
       out.Close();
    } else {
       FileFd out, inp;
       out.OpenDescriptor(STDOUT_FILENO, FileFd::WriteOnly | FileFd::Create | FileFd::BufferedWrite);
       inp.OpenDescriptor(STDIN_FILENO, FileFd::ReadOnly);
-      patch.apply_against_file(out, inp);
-      out.Close();
+      if (patch.apply_against_file(out, inp) == false || out.Close() == false)
+      {
+	 _error->DumpErrors(std::cerr);
+	 exit(3);
+      }
    }
    return 0;
 }
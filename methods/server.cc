@@ -563,6 +563,9 @@ int ServerMethod::Loop()
       int Result = Run(true);
       if (Result != -1 && (Result != 0 || Queue == 0))
       {
+	 // nothing is in flight, so the connection is idle now
+	 if (Server != nullptr && Queue == QueueBack)
+	    Server->Park();
 	 if(FailReason.empty() == false ||
 	    ConfigFindB("DependOnSTDIN", true) == true)
 	    return 100;
@@ -576,6 +579,8 @@ int ServerMethod::Loop()
       // Connect to the server
       if (Server == 0 || Server->Comp(Queue->Uri) == false)
       {
+	 if (Server != nullptr && Queue == QueueBack)
+	    Server->Park();
 	 Server = CreateServerState(Queue->Uri);
 	 setPostfixForMethodNames(::URI(Queue->Uri).Host.c_str());
 	 AllowRedirect = ConfigFindB("AllowRedirect", true);
@@ -714,6 +719,9 @@ int ServerMethod::Loop()
 		  }
 	       }
 	       Res.TakeHashes(*resultHashes);
+	       // the acquire system might stop us right after the last item
+	       if (Queue->Next == nullptr)
+		  Server->Park();
 	       URIDone(Res);
 	    }
 	    else
@@ -744,6 +752,8 @@ int ServerMethod::Loop()
 	 // IMS hit
 	 case IMS_HIT:
 	 {
+	    if (Queue->Next == nullptr)
+	       Server->Park();
 	    URIDone(Res);
 	    break;
 	 }
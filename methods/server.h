@@ -95,6 +95,8 @@ struct ServerState
    virtual bool Open() = 0;
    virtual bool IsOpen() = 0;
    virtual bool Close() = 0;
+   /** \brief Offer an idle connection for later use, it stays open otherwise */
+   virtual bool Park() { return true; }
    virtual bool InitHashes(HashStringList const &ExpectedHashes) = 0;
    virtual Hashes * GetHashes() = 0;
    virtual bool Die(FileFd * const File) = 0;
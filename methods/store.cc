@@ -24,7 +24,12 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <apti18n.h>
@@ -36,7 +41,7 @@ class StoreMethod : public aptMethod
 
    public:
 
-   explicit StoreMethod(std::string &&pProg) : aptMethod(std::move(pProg),"1.2",SingleInstance | SendConfig)
+   explicit StoreMethod(std::string &&pProg) : aptMethod(std::move(pProg),"1.2",SendConfig)
    {
       if (Binary != "store")
 	 methodNames.insert(methodNames.begin(), "store");
@@ -58,7 +63,133 @@ static bool OpenFileWithCompressorByName(FileFd &fileFd, std::string const &File
    return fileFd.Open(Filename, Mode, *compressor);
 }
 
+									/*}}}*/
+// BlockQueue - Hands blocks of data from one thread to the next	/*{{{*/
+class BlockQueue
+{
+   public:
+   typedef std::shared_ptr<std::vector<unsigned char> const> Block;
+
+   private:
+   std::deque<Block> Blocks;
+   bool Finished;
+   bool Aborted;
+   std::mutex Lock;
+   std::condition_variable Changed;
+
+   public:
+   /** \brief queue a block, waits if the consumer is far behind
+    *
+    *  \return false if the consumer gave up */
+   bool Push(Block const &Data)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Changed.wait(Guard, [this]() { return Aborted == true || Blocks.size() < 16; });
+      if (Aborted == true)
+	 return false;
+      Blocks.push_back(Data);
+      Changed.notify_all();
+      return true;
+   }
+   /** \brief take the next block, waits until one is available
+    *
+    *  \return false if no more blocks will come */
+   bool Pop(Block &Data)
+   {
+      std::unique_lock<std::mutex> Guard(Lock);
+      Changed.wait(Guard, [this]() { return Aborted == true || Finished == true || Blocks.empty() == false; });
+      if (Aborted == true || Blocks.empty() == true)
+	 return false;
+      Data = std::move(Blocks.front());
+      Blocks.pop_front();
+      Changed.notify_all();
+      return true;
+   }
+   /** \brief the producer has no more blocks */
+   void Finish()
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Finished = true;
+      Changed.notify_all();
+   }
+   /** \brief drop all blocks and stop producer and consumer */
+   void Abort()
+   {
+      std::lock_guard<std::mutex> Guard(Lock);
+      Aborted = true;
+      Blocks.clear();
+      Changed.notify_all();
+   }
+
+   BlockQueue() : Finished(false), Aborted(false) {}
+};
+									/*}}}*/
+// StoreInThreads - Extract, hash and write the file on own threads	/*{{{*/
+// ---------------------------------------------------------------------
+/* Extracting the input, calculating the hashes and recompressing the
+   output are all expensive, so with Acquire::store::Threads each of them
+   is done on its own thread with the blocks read passed along. */
+static bool StoreInThreads(FileFd &From, FileFd &To, Hashes &Hash, unsigned long long &Size)
+{
+   BlockQueue ToHash, ToWrite;
+   std::string ReadError;
+   // the FileFd is only used by the main thread once the others run
+   bool const Writing = To.IsOpen();
+   std::thread Reader([&]() {
+      while (true)
+      {
+	 std::vector<unsigned char> Buffer(64*1024);
+	 unsigned long long Count = 0;
+	 if (From.Read(Buffer.data(), Buffer.size(), &Count) == false)
+	 {
+	    // errors are per thread, so they have to be passed on to the main thread
+	    _error->PopMessage(ReadError);
+	    _error->Discard();
+	    if (ReadError.empty() == true)
+	       ReadError = "Read error";
+	    break;
+	 }
+	 if (Count == 0)
+	    break;
+	 Size += Count;
+	 Buffer.resize(Count);
+	 BlockQueue::Block const Data = std::make_shared<std::vector<unsigned char>>(std::move(Buffer));
+	 if (ToHash.Push(Data) == false || (Writing == true && ToWrite.Push(Data) == false))
+	    break;
+      }
+      ToHash.Finish();
+      ToWrite.Finish();
+   });
+   std::thread Hasher([&]() {
+      BlockQueue::Block Data;
+      while (ToHash.Pop(Data) == true)
+	 Hash.Add(Data->data(), Data->size());
+   });
 
+   bool Failed = false;
+   BlockQueue::Block Data;
+   while (Writing == true && ToWrite.Pop(Data) == true)
+   {
+      if (To.Write(Data->data(), Data->size()) == false)
+      {
+	 Failed = true;
+	 ToWrite.Abort();
+	 ToHash.Abort();
+	 break;
+      }
+   }
+   Reader.join();
+   Hasher.join();
+
+   if (ReadError.empty() == false)
+   {
+      _error->Error("%s", ReadError.c_str());
+      if (To.IsOpen())
+	 To.OpFail();
+      return false;
+   }
+   return Failed == false;
+}
 									/*}}}*/
 bool StoreMethod::Fetch(FetchItem *Itm)					/*{{{*/
 {
@@ -100,9 +231,11 @@ bool StoreMethod::Fetch(FetchItem *Itm)					/*{{{*/
    Hashes Hash(Itm->ExpectedHashes);
    bool Failed = false;
    Res.Size = 0;
-   while (1)
+   if (ConfigFindB("Threads", false) == true)
+      Failed = StoreInThreads(From, To, Hash, Res.Size) == false;
+   else while (1)
    {
-      unsigned char Buffer[4*1024];
+      unsigned char Buffer[64*1024];
       unsigned long long Count = 0;
 
       if (!From.Read(Buffer,sizeof(Buffer),&Count))
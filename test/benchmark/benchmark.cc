@@ -0,0 +1,456 @@
+/* Measures the throughput of some hot paths in libapt-pkg on synthetic,
+   but reproducible input: The same seed generates the same Packages file,
+   version strings and buffers, so numbers can be compared between builds.
+
+   Usage: benchmark [--seed N] [--stanzas N] [--size MiB] [--min-time sec]
+                    [--rred path] [--patches N]
+                    [hashes] [compressors] [tagfile] [versions] [rred]
+*/
+#include <config.h>
+
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/debversion.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/hashes.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/tagfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static double MinTime = 1.0;
+
+// Run the given function until MinTime is used up, return seconds per run
+template<typename Function> static double Measure(Function const &Run)
+{
+   auto const Start = std::chrono::steady_clock::now();
+   unsigned long long Rounds = 0;
+   double Elapsed = 0;
+   do {
+      Run();
+      ++Rounds;
+      Elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+   } while (Elapsed < MinTime);
+   return Elapsed / Rounds;
+}
+static void Report(std::string const &Name, double const Seconds,
+      unsigned long long const Bytes, unsigned long long const Ops)
+{
+   printf("%-32s", Name.c_str());
+   if (Bytes != 0)
+      printf(" %10.1f MB/s", Bytes / Seconds / 1000 / 1000);
+   else
+      printf(" %15s", "");
+   if (Ops != 0)
+      printf(" %12.1f ns/op", Seconds * 1000 * 1000 * 1000 / Ops);
+   printf("\n");
+   fflush(stdout);
+}
+
+// synthetic input							/*{{{*/
+static std::string RandomString(std::mt19937 &Rand, char const * const Chars, size_t const Length)
+{
+   std::uniform_int_distribution<size_t> Pick(0, strlen(Chars) - 1);
+   std::string S;
+   S.reserve(Length);
+   for (size_t i = 0; i < Length; ++i)
+      S.push_back(Chars[Pick(Rand)]);
+   return S;
+}
+static std::string RandomVersion(std::mt19937 &Rand)
+{
+   std::uniform_int_distribution<int> Small(0, 9);
+   std::uniform_int_distribution<int> Big(0, 2016);
+   std::string V;
+   if (Small(Rand) == 0)
+      V.append(std::to_string(Small(Rand) + 1)).append(":");
+   V.append(std::to_string(Big(Rand) % 30));
+   for (int i = Small(Rand) % 4; i >= 0; --i)
+      V.append(".").append(std::to_string(Small(Rand) == 0 ? Big(Rand) : Small(Rand)));
+   switch (Small(Rand))
+   {
+      case 0: V.append("~rc").append(std::to_string(Small(Rand))); break;
+      case 1: V.append("+dfsg"); break;
+      case 2: V.append(RandomString(Rand, "abcdefz", 1)); break;
+      case 3: V.append("+git").append(std::to_string(20160000 + Big(Rand))); break;
+   }
+   if (Small(Rand) < 8)
+   {
+      V.append("-").append(std::to_string(Small(Rand) + 1));
+      if (Small(Rand) < 3)
+	 V.append("ubuntu").append(std::to_string(Small(Rand)));
+      else if (Small(Rand) < 2)
+	 V.append("+deb9u").append(std::to_string(Small(Rand) + 1));
+   }
+   return V;
+}
+static std::string GeneratePackages(std::mt19937 &Rand, unsigned long const Stanzas)
+{
+   char const * const Hex = "0123456789abcdef";
+   char const * const Lower = "abcdefghijklmnopqrstuvwxyz";
+   char const * const Sections[] = { "admin", "devel", "libs", "net", "utils", "web", "x11" };
+   char const * const Priorities[] = { "required", "important", "standard", "optional", "extra" };
+   std::uniform_int_distribution<unsigned long> Package(0, Stanzas - 1);
+   std::uniform_int_distribution<int> Small(0, 6);
+   std::uniform_int_distribution<int> Size(1000, 10000000);
+
+   std::string P;
+   for (unsigned long i = 0; i < Stanzas; ++i)
+   {
+      std::string const Name = "pkg" + std::to_string(i) + "-" + RandomString(Rand, Lower, 5);
+      std::string const Version = RandomVersion(Rand);
+      P.append("Package: ").append(Name).append("\n");
+      P.append("Version: ").append(Version).append("\n");
+      P.append("Architecture: amd64\n");
+      P.append("Installed-Size: ").append(std::to_string(Size(Rand) / 1000)).append("\n");
+      P.append("Maintainer: ").append(RandomString(Rand, Lower, 8)).append(" <").append(RandomString(Rand, Lower, 8)).append("@example.org>\n");
+      P.append("Priority: ").append(Priorities[Small(Rand) % 5]).append("\n");
+      P.append("Section: ").append(Sections[Small(Rand)]).append("\n");
+      P.append("Depends: libc6 (>= 2.14)");
+      for (int d = Small(Rand); d > 0; --d)
+      {
+	 P.append(", pkg").append(std::to_string(Package(Rand)));
+	 if (Small(Rand) < 3)
+	    P.append(" (>= ").append(RandomVersion(Rand)).append(")");
+	 if (Small(Rand) == 0)
+	    P.append(" | pkg").append(std::to_string(Package(Rand)));
+      }
+      P.append("\n");
+      P.append("Filename: pool/main/").append(Name, 0, 1).append("/").append(Name).append("/").append(Name).append("_").append(Version).append("_amd64.deb\n");
+      P.append("Size: ").append(std::to_string(Size(Rand))).append("\n");
+      P.append("MD5sum: ").append(RandomString(Rand, Hex, 32)).append("\n");
+      P.append("SHA256: ").append(RandomString(Rand, Hex, 64)).append("\n");
+      P.append("Description: ").append(RandomString(Rand, Lower, 40)).append("\n");
+      for (int d = Small(Rand) % 4; d >= 0; --d)
+	 P.append(" ").append(RandomString(Rand, Lower, 70)).append("\n");
+      P.append("\n");
+   }
+   return P;
+}
+									/*}}}*/
+static void BenchmarkHashes(std::vector<unsigned char> const &Buffer)	/*{{{*/
+{
+   std::vector<std::pair<char const *, unsigned int>> const Algos = {
+      { "MD5Sum", Hashes::MD5SUM },
+      { "SHA1", Hashes::SHA1SUM },
+      { "SHA256", Hashes::SHA256SUM },
+      { "SHA512", Hashes::SHA512SUM },
+      { "all", ~0u },
+   };
+   for (auto const &A: Algos)
+   {
+      double const Seconds = Measure([&]() {
+	 Hashes Hash(A.second);
+	 Hash.Add(Buffer.data(), Buffer.size());
+	 Hash.GetHashStringList();
+      });
+      Report(std::string("Hashes::Add ") + A.first, Seconds, Buffer.size(), 0);
+   }
+}
+									/*}}}*/
+static bool BenchmarkCompressors(std::string const &Packages)		/*{{{*/
+{
+   std::string const Tmp = flCombine(GetTempDir(), "apt-benchmark");
+   for (auto const &C: APT::Configuration::getCompressors())
+   {
+      std::string const File = Tmp + C.Extension;
+      std::string const Name = C.Name == "." ? "uncompressed" : C.Name;
+      double const Write = Measure([&]() {
+	 FileFd Fd;
+	 if (Fd.Open(File, FileFd::WriteOnly | FileFd::Create | FileFd::Empty, C) == false ||
+	       Fd.Write(Packages.data(), Packages.size()) == false ||
+	       Fd.Close() == false)
+	    _error->Error("Compressing with %s failed", C.Name.c_str());
+      });
+      if (_error->PendingError() == true)
+	 break;
+      Report("FileFd write " + Name, Write, Packages.size(), 0);
+
+      std::vector<char> Buffer(64 * 1024);
+      double const Read = Measure([&]() {
+	 FileFd Fd;
+	 if (Fd.Open(File, FileFd::ReadOnly, C) == false)
+	    return;
+	 unsigned long long Actual = 0;
+	 while (Fd.Read(Buffer.data(), Buffer.size(), &Actual) == true && Actual != 0)
+	    ;
+      });
+      RemoveFile("BenchmarkCompressors", File);
+      if (_error->PendingError() == true)
+	 break;
+      Report("FileFd read " + Name, Read, Packages.size(), 0);
+   }
+   return _error->PendingError() == false;
+}
+									/*}}}*/
+static bool BenchmarkTagSection(std::string const &Packages, unsigned long const Stanzas)/*{{{*/
+{
+   pkgTagSection Section;
+   unsigned long Found = 0;
+   double const Seconds = Measure([&]() {
+      char const *Start = Packages.c_str();
+      char const * const End = Start + Packages.size();
+      Found = 0;
+      while (Start < End && Section.Scan(Start, End - Start) == true)
+      {
+	 Start += Section.size();
+	 ++Found;
+      }
+   });
+   if (Found != Stanzas)
+      return _error->Error("Scan found %lu stanzas instead of %lu", Found, Stanzas);
+   Report("pkgTagSection::Scan", Seconds, Packages.size(), Stanzas);
+   return true;
+}
+									/*}}}*/
+static void BenchmarkVersions(std::mt19937 &Rand)			/*{{{*/
+{
+   std::vector<std::string> Versions(100000);
+   for (auto &V: Versions)
+      V = RandomVersion(Rand);
+   volatile int Sum = 0;
+   double const Seconds = Measure([&]() {
+      for (size_t i = 1; i < Versions.size(); ++i)
+	 Sum += debVS.CmpVersion(Versions[i - 1], Versions[i]);
+   });
+   Report("debVersioningSystem::CmpVersion", Seconds, 0, Versions.size() - 1);
+}
+									/*}}}*/
+static std::string GeneratePatch(std::mt19937 &Rand, std::vector<std::string> &Lines)/*{{{*/
+{
+   char const * const Lower = "abcdefghijklmnopqrstuvwxyz";
+   std::uniform_int_distribution<size_t> Line(1, Lines.size() - 4);
+   std::uniform_int_distribution<int> Small(0, 9);
+   std::vector<size_t> Where(Lines.size() / 250 + 1);
+   for (auto &W: Where)
+      W = Line(Rand);
+   std::sort(Where.begin(), Where.end());
+
+   // each change is a replaced, removed or added block of lines
+   struct Change {
+      size_t Line;
+      size_t Delete;
+      std::vector<std::string> Add;
+   };
+   std::vector<Change> Changes;
+   for (auto const W: Where)
+   {
+      // keep the changes apart, so that they don't overlap
+      if (Changes.empty() == false && Changes.back().Line + 4 >= W)
+	 continue;
+      Change C{W, 0, {}};
+      int const Op = Small(Rand);
+      if (Op < 6)
+      {
+	 C.Delete = 1;
+	 C.Add.push_back("Version: " + RandomVersion(Rand));
+      }
+      else if (Op < 8)
+	 C.Delete = Small(Rand) % 3 + 1;
+      else
+	 for (int Count = Small(Rand) % 3 + 1; Count > 0; --Count)
+	    C.Add.push_back(" " + RandomString(Rand, Lower, 70));
+      Changes.push_back(std::move(C));
+   }
+
+   // an ed script as in pdiffs: the commands go from the end of the file to its start
+   std::string Patch;
+   for (auto C = Changes.rbegin(); C != Changes.rend(); ++C)
+   {
+      Patch.append(std::to_string(C->Line));
+      if (C->Delete > 1)
+	 Patch.append(",").append(std::to_string(C->Line + C->Delete - 1));
+      Patch.append(C->Delete == 0 ? "a\n" : (C->Add.empty() ? "d\n" : "c\n"));
+      for (auto const &A: C->Add)
+	 Patch.append(A).append("\n");
+      if (C->Add.empty() == false)
+	 Patch.append(".\n");
+   }
+
+   std::vector<std::string> Patched;
+   Patched.reserve(Lines.size() + Changes.size());
+   size_t Next = 0;
+   for (auto &C: Changes)
+   {
+      // lines are counted from 1, an added block follows its line
+      size_t const Keep = C.Delete == 0 ? C.Line : C.Line - 1;
+      std::move(Lines.begin() + Next, Lines.begin() + Keep, std::back_inserter(Patched));
+      std::move(C.Add.begin(), C.Add.end(), std::back_inserter(Patched));
+      Next = Keep + C.Delete;
+   }
+   std::move(Lines.begin() + Next, Lines.end(), std::back_inserter(Patched));
+   Lines.swap(Patched);
+   return Patch;
+}
+									/*}}}*/
+static bool BenchmarkRred(std::string const &Rred, std::string const &Packages,/*{{{*/
+      std::mt19937 &Rand, unsigned long const Count)
+{
+   std::string const Tmp = flCombine(GetTempDir(), "apt-benchmark-rred");
+   std::vector<std::string> Lines = VectorizeString(Packages, '\n');
+   std::vector<std::string> Patches;
+   for (unsigned long i = 0; i < Count; ++i)
+   {
+      std::string const Patch = Tmp + ".patch" + std::to_string(i);
+      std::string const Text = GeneratePatch(Rand, Lines);
+      FileFd Fd;
+      if (Fd.Open(Patch, FileFd::WriteOnly | FileFd::Create | FileFd::Empty) == false ||
+	    Fd.Write(Text.data(), Text.size()) == false || Fd.Close() == false)
+	 return false;
+      Patches.push_back(Patch);
+   }
+   std::string const Input = Tmp + ".input";
+   std::string const Output = Tmp + ".output";
+   {
+      FileFd Fd;
+      if (Fd.Open(Input, FileFd::WriteOnly | FileFd::Create | FileFd::Empty) == false ||
+	    Fd.Write(Packages.data(), Packages.size()) == false || Fd.Close() == false)
+	 return false;
+   }
+
+   // rred -f merges all patches before it applies them on stdin
+   std::vector<char const *> Args = { Rred.c_str(), "-f" };
+   for (auto const &P: Patches)
+      Args.push_back(P.c_str());
+   Args.push_back(nullptr);
+   double const Seconds = Measure([&]() {
+      FileFd In, Out;
+      if (In.Open(Input, FileFd::ReadOnly) == false ||
+	    Out.Open(Output, FileFd::WriteOnly | FileFd::Create | FileFd::Empty) == false)
+	 return;
+      pid_t const Child = ExecFork({ In.Fd(), Out.Fd() });
+      if (Child == 0)
+      {
+	 dup2(In.Fd(), STDIN_FILENO);
+	 dup2(Out.Fd(), STDOUT_FILENO);
+	 execv(Args[0], const_cast<char **>(Args.data()));
+	 std::cerr << "Failed to execute '" << Rred << "'!" << std::endl;
+	 _exit(100);
+      }
+      ExecWait(Child, "rred", false);
+   });
+
+   bool Okay = _error->PendingError() == false;
+   if (Okay == true)
+   {
+      std::string Expected;
+      for (auto const &L: Lines)
+	 Expected.append(L).append("\n");
+      FileFd Fd;
+      std::string Got;
+      if (Fd.Open(Output, FileFd::ReadOnly) == true)
+      {
+	 Got.resize(Fd.Size());
+	 Okay = Fd.Read(&Got[0], Got.size());
+      }
+      else
+	 Okay = false;
+      if (Okay == true && Got != Expected)
+	 Okay = _error->Error("rred created a different file than expected in %s", Output.c_str());
+   }
+   if (Okay == true)
+      Report("rred " + std::to_string(Count) + " patches", Seconds, Packages.size(), 0);
+
+   for (auto const &P: Patches)
+      RemoveFile("BenchmarkRred", P);
+   RemoveFile("BenchmarkRred", Input);
+   if (Okay == true)
+      RemoveFile("BenchmarkRred", Output);
+   return Okay;
+}
+									/*}}}*/
+int main(int argc, char *argv[])
+{
+   unsigned long Seed = 42;
+   unsigned long Stanzas = 50000;
+   unsigned long Size = 32;
+   unsigned long PatchCount = 100;
+   std::string Rred = RRED_BINARY;
+   std::vector<std::string> Groups;
+   for (int i = 1; i < argc; ++i)
+   {
+      std::string const Arg = argv[i];
+      if (i + 1 < argc && Arg == "--seed")
+	 Seed = strtoul(argv[++i], nullptr, 10);
+      else if (i + 1 < argc && Arg == "--stanzas")
+	 Stanzas = strtoul(argv[++i], nullptr, 10);
+      else if (i + 1 < argc && Arg == "--size")
+	 Size = strtoul(argv[++i], nullptr, 10);
+      else if (i + 1 < argc && Arg == "--min-time")
+	 MinTime = strtod(argv[++i], nullptr);
+      else if (i + 1 < argc && Arg == "--rred")
+	 Rred = argv[++i];
+      else if (i + 1 < argc && Arg == "--patches")
+	 PatchCount = strtoul(argv[++i], nullptr, 10);
+      else if (Arg == "hashes" || Arg == "compressors" || Arg == "tagfile" || Arg == "versions" || Arg == "rred")
+	 Groups.push_back(Arg);
+      else
+      {
+	 std::cerr << "Usage: " << argv[0] << " [--seed N] [--stanzas N] [--size MiB] [--min-time sec]" << std::endl
+	    << "\t[--rred path] [--patches N]" << std::endl
+	    << "\t[hashes] [compressors] [tagfile] [versions] [rred]" << std::endl;
+	 return 100;
+      }
+   }
+   if (Stanzas == 0 || Size == 0 || PatchCount == 0)
+   {
+      std::cerr << "--stanzas, --size and --patches need to be positive" << std::endl;
+      return 100;
+   }
+   auto const Run = [&](char const * const Group) {
+      return Groups.empty() || std::find(Groups.begin(), Groups.end(), Group) != Groups.end();
+   };
+   if (pkgInitConfig(*_config) == false)
+   {
+      _error->DumpErrors();
+      return 100;
+   }
+
+   // each input has its own generator so it doesn't depend on the groups run
+   if (Run("hashes"))
+   {
+      std::vector<unsigned char> Buffer(Size * 1024 * 1024);
+      std::independent_bits_engine<std::mt19937, 8, unsigned short> Bytes(Seed);
+      for (auto &B: Buffer)
+	 B = Bytes();
+      BenchmarkHashes(Buffer);
+   }
+   if (Run("compressors") || Run("tagfile"))
+   {
+      std::mt19937 Rand(Seed + 1);
+      std::string const Packages = GeneratePackages(Rand, Stanzas);
+      if (Run("tagfile"))
+	 BenchmarkTagSection(Packages, Stanzas);
+      if (Run("compressors"))
+	 BenchmarkCompressors(Packages);
+   }
+   if (Run("versions"))
+   {
+      std::mt19937 Rand(Seed + 2);
+      BenchmarkVersions(Rand);
+   }
+   if (Run("rred"))
+   {
+      std::mt19937 Rand(Seed + 3);
+      std::string const Packages = GeneratePackages(Rand, Stanzas);
+      BenchmarkRred(Rred, Packages, Rand, PatchCount);
+   }
+
+   bool const Errors = _error->PendingError();
+   _error->DumpErrors();
+   return Errors ? 100 : 0;
+}
@@ -0,0 +1,581 @@
+/* Replays a corpus of EDSP scenarios through one or more solvers and reports
+   the wall time, the peak memory and the size of the solution for each, so
+   that resolver changes can be measured between builds and releases.
+
+   A corpus can be captured from real requests with the dump solver
+   (apt-get --solver dump, see APT_EDSP_DUMP_FILENAME) or taken from
+   Dir::Log::Solver, compressed or not. The generate command creates
+   synthetic, but reproducible scenarios modelled after an amd64 system with
+   i386 enabled and a full archive: the same seed generates the same files.
+
+   Usage: solver-benchmark [--solver PATH]... [--runs N] scenario|dir...
+          solver-benchmark generate [--seed N] [--packages N] dir
+
+   The solvers are run without arguments like apt does it, so their options
+   have to be set in the configuration, e.g. via APT_CONFIG.
+*/
+#include <config.h>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/strutl.h>
+#include <apt-pkg/tagfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// synthetic scenarios							/*{{{*/
+/* Package i only depends on packages with a lower index, so the lowest
+   ones are the libc-like packages everything ends up depending on. Each
+   package has an old version, which is installed if it is installed at all,
+   and a new one in the archive – the latter can require newer versions of
+   its dependencies, break old versions of others or depend on a renamed
+   library. Some installed packages are obsolete: they are in no archive. */
+namespace {
+enum class Kind { Library, Program, Data };
+struct Dependency
+{
+   size_t Target;
+   bool Versioned;
+   size_t Alternative;	// Target again if there is none
+};
+struct Package
+{
+   std::string Name;
+   Kind Type;
+   std::string MultiArch;
+   std::string OldVersion;
+   std::string NewVersion;
+   bool Upgrade = false;
+   bool Obsolete = false;
+   size_t RenamedTo = 0;	// the library replacing this one, if not 0
+   std::vector<Dependency> OldDepends;
+   std::vector<Dependency> NewDepends;
+   std::vector<size_t> Breaks;
+   std::string Provides;
+   bool Conflicts = false;	// with the other providers of Provides
+   bool Essential = false;
+   // installed for amd64 and i386, a Data package only uses the first
+   bool Installed[2] = { false, false };
+   bool Manual[2] = { false, false };
+};
+class ScenarioGenerator
+{
+   std::mt19937 Rand;
+   std::vector<Package> Pkgs;
+   std::vector<std::string> Virtuals;
+   unsigned long ID = 0;
+
+   bool Chance(double const P) { return std::uniform_real_distribution<double>(0, 1)(Rand) < P; }
+   size_t Below(size_t const N) { return std::uniform_int_distribution<size_t>(0, N - 1)(Rand); }
+   // lower indexes are more popular, like libc is in a real archive
+   size_t Popular(size_t const N)
+   {
+      double const U = std::uniform_real_distribution<double>(0, 1)(Rand);
+      return std::min(N - 1, static_cast<size_t>(N * U * U * U));
+   }
+
+   std::string const &Version(size_t const P, bool const Old) const
+   {
+      return Old ? Pkgs[P].OldVersion : Pkgs[P].NewVersion;
+   }
+   std::string DependsLine(std::vector<Dependency> const &Depends, bool const Old) const
+   {
+      std::string Line;
+      for (auto const &D : Depends)
+      {
+	 size_t Target = D.Target;
+	 if (Old == false && Pkgs[Target].RenamedTo != 0)
+	    Target = Pkgs[Target].RenamedTo;
+	 if (Line.empty() == false)
+	    Line.append(", ");
+	 Line.append(Pkgs[Target].Name);
+	 if (D.Versioned == true)
+	    Line.append(" (>= ").append(Version(Target, Old)).append(")");
+	 if (D.Alternative != D.Target)
+	    Line.append(" | ").append(Pkgs[D.Alternative].Name);
+      }
+      return Line;
+   }
+   // the architecture a dependency of an arch-dependent package resolves to
+   unsigned int TargetArch(size_t const Target, unsigned int const Arch) const
+   {
+      if (Pkgs[Target].Type == Kind::Data || Pkgs[Target].MultiArch == "foreign")
+	 return 0;
+      return Arch;
+   }
+   void Install(size_t const P, unsigned int const Arch)
+   {
+      std::vector<std::pair<size_t, unsigned int>> Todo = { { P, Arch } };
+      while (Todo.empty() == false)
+      {
+	 auto const Cur = Todo.back();
+	 Todo.pop_back();
+	 auto &Pkg = Pkgs[Cur.first];
+	 if (Pkg.Installed[Cur.second] == true)
+	    continue;
+	 Pkg.Installed[Cur.second] = true;
+	 for (auto const &D : Pkg.OldDepends)
+	    Todo.emplace_back(D.Target, TargetArch(D.Target, Cur.second));
+      }
+   }
+
+   void Generate(size_t const Count)
+   {
+      static char const * const Words[] = { "core", "util", "net", "gtk", "qt", "perl",
+	 "python", "ssl", "xml", "sql", "font", "image", "audio", "video", "doc", "kernel" };
+      std::uniform_int_distribution<int> Small(0, 9);
+      Pkgs.resize(Count);
+      Virtuals.resize(std::max<size_t>(1, Count / 300));
+      for (size_t v = 0; v < Virtuals.size(); ++v)
+	 Virtuals[v] = "virtual-" + std::to_string(v);
+
+      for (size_t i = 0; i < Count; ++i)
+      {
+	 auto &P = Pkgs[i];
+	 std::string const Word = Words[Below(sizeof(Words) / sizeof(Words[0]))];
+	 int const Type = Small(Rand);
+	 if (i < 20 || Type < 3)
+	 {
+	    P.Type = Kind::Library;
+	    P.MultiArch = "same";
+	    P.Name = "lib" + Word + std::to_string(i) + "-" + std::to_string(Small(Rand) + 1);
+	 }
+	 else if (Type < 8)
+	 {
+	    P.Type = Kind::Program;
+	    P.MultiArch = Small(Rand) < 2 ? "foreign" : "";
+	    P.Name = Word + std::to_string(i);
+	 }
+	 else
+	 {
+	    P.Type = Kind::Data;
+	    P.MultiArch = Small(Rand) < 4 ? "foreign" : "";
+	    P.Name = Word + std::to_string(i) + "-data";
+	 }
+	 P.Essential = i < 10;
+	 int const Major = Small(Rand) + 1;
+	 int const Minor = Small(Rand) * 3;
+	 P.OldVersion = std::to_string(Major) + "." + std::to_string(Minor) + "-1";
+	 P.Upgrade = Small(Rand) < 6;
+	 if (P.Upgrade == true)
+	    P.NewVersion = std::to_string(Major) + "." + std::to_string(Minor + 1) + "-1";
+	 else
+	    P.NewVersion = P.OldVersion;
+	 P.Obsolete = i >= 20 && Small(Rand) == 0 && Chance(0.2);
+
+	 if (i != 0)
+	 {
+	    // data packages depend on nothing, libraries only on libraries
+	    int Deps = P.Type == Kind::Data ? 0 : std::min<int>(i, Small(Rand) % 7);
+	    std::set<size_t> Seen;
+	    for (; Deps > 0; --Deps)
+	    {
+	       size_t Target = Popular(i);
+	       if (P.Type == Kind::Library && Pkgs[Target].Type != Kind::Library)
+		  continue;
+	       if (Seen.insert(Target).second == false || Pkgs[Target].Obsolete == true)
+		  continue;
+	       Dependency D{Target, Small(Rand) < 4, Target};
+	       if (P.Type == Kind::Program && Small(Rand) == 0)
+		  D.Alternative = Below(i);
+	       P.OldDepends.push_back(D);
+	    }
+	    // the libc of this archive
+	    if (P.Type != Kind::Data && Seen.insert(0).second == true)
+	       P.OldDepends.push_back({0, Small(Rand) < 4, 0});
+	    P.NewDepends = P.OldDepends;
+	    if (P.Upgrade == true)
+	    {
+	       // the new version might need new versions and a new dependency
+	       for (auto &D : P.NewDepends)
+		  if (D.Versioned == false && Small(Rand) < 3)
+		     D.Versioned = true;
+	       size_t const Target = Popular(i);
+	       if (Seen.count(Target) == 0 && Pkgs[Target].Obsolete == false &&
+		     (P.Type != Kind::Library || Pkgs[Target].Type == Kind::Library))
+		  P.NewDepends.push_back({Target, false, Target});
+	       if (Small(Rand) == 0)
+		  P.Breaks.push_back(Below(i));
+	    }
+	 }
+	 if (P.Type == Kind::Program && Small(Rand) == 0)
+	 {
+	    P.Provides = Virtuals[Below(Virtuals.size())];
+	    P.Conflicts = Small(Rand) < 5;
+	 }
+      }
+
+      // library transitions: the new versions depend on the renamed library
+      for (size_t i = 20; i < Count; ++i)
+      {
+	 if (Pkgs[i].Type != Kind::Library || Pkgs[i].Obsolete == true || Small(Rand) != 0)
+	    continue;
+	 Package N = Pkgs[i];
+	 N.Name = Pkgs[i].Name + "t64";
+	 N.Upgrade = true;
+	 N.Breaks.clear();
+	 Pkgs[i].RenamedTo = Pkgs.size();
+	 Pkgs.push_back(N);
+      }
+
+      // a system with some programs and a few foreign libraries installed
+      for (size_t i = 0; i < 10; ++i)
+	 Install(i, 0);
+      size_t const Manual = std::max<size_t>(10, Count / 40);
+      for (size_t m = 0; m < Manual; ++m)
+      {
+	 size_t const P = 10 + Below(Count - 10);
+	 unsigned int const Arch = (Pkgs[P].Type == Kind::Library && m % 5 == 0) ? 1 : 0;
+	 if (Pkgs[P].Installed[Arch] == true || Pkgs[P].Obsolete == true)
+	    continue;
+	 Pkgs[P].Manual[Arch] = true;
+	 Install(P, Arch);
+      }
+      /* only providers nothing depends on conflict, like mail transport
+	 agents do, and installed providers of the same virtual can't */
+      std::vector<bool> Needed(Pkgs.size(), false);
+      for (auto const &P : Pkgs)
+	 for (auto const &D : P.NewDepends)
+	    Needed[D.Target] = Needed[D.Alternative] = true;
+      std::map<std::string, std::vector<size_t>> Providers;
+      for (size_t i = 0; i < Pkgs.size(); ++i)
+      {
+	 if (Needed[i] == true)
+	    Pkgs[i].Conflicts = false;
+	 if (Pkgs[i].Provides.empty() == false && Pkgs[i].Installed[0] == true)
+	    Providers[Pkgs[i].Provides].push_back(i);
+      }
+      for (auto const &V : Providers)
+	 if (V.second.size() > 1)
+	    for (auto const P : V.second)
+	       Pkgs[P].Conflicts = false;
+   }
+
+   std::string Stanza(Package const &P, char const * const Arch, bool const Old,
+	 bool const Installed, bool const Manual, bool const Candidate)
+   {
+      bool const InArchive = P.Obsolete == false && P.RenamedTo == 0 &&
+	 (Old == false || P.Upgrade == false);
+      // a package without an upgrade has only the old version
+      bool const OldDepends = Old == true || P.Upgrade == false;
+      std::string S;
+      S.append("Package: ").append(P.Name);
+      S.append("\nArchitecture: ").append(Arch);
+      S.append("\nVersion: ").append(Old ? P.OldVersion : P.NewVersion);
+      S.append("\nAPT-ID: ").append(std::to_string(ID++));
+      if (P.MultiArch.empty() == false)
+	 S.append("\nMulti-Arch: ").append(P.MultiArch);
+      if (P.Essential == true && strcmp(Arch, "i386") != 0)
+	 S.append("\nEssential: yes");
+      S.append("\nSource: ").append(P.Name);
+      S.append("\nSource-Version: ").append(Old ? P.OldVersion : P.NewVersion);
+      S.append("\nPriority: ").append(P.Essential ? "required" : "optional");
+      S.append("\nSection: ").append(P.Type == Kind::Library ? "libs" : "misc");
+      if (Installed == true)
+	 S.append("\nInstalled: yes");
+      if (InArchive == true)
+	 S.append("\nAPT-Release:\n a=unstable,n=sid,c=main,b=").append(Arch);
+      S.append("\nAPT-Pin: ").append(InArchive ? "500" : "100");
+      if (Candidate == true)
+	 S.append("\nAPT-Candidate: yes");
+      if (Installed == true && Manual == false)
+	 S.append("\nAPT-Automatic: yes");
+      std::string const Depends = DependsLine(OldDepends ? P.OldDepends : P.NewDepends, OldDepends);
+      if (Depends.empty() == false)
+	 S.append("\nDepends: ").append(Depends);
+      if (OldDepends == false && P.Breaks.empty() == false)
+      {
+	 S.append("\nBreaks: ");
+	 for (auto B = P.Breaks.begin(); B != P.Breaks.end(); ++B)
+	 {
+	    if (B != P.Breaks.begin())
+	       S.append(", ");
+	    S.append(Pkgs[*B].Name).append(" (<< ").append(Pkgs[*B].NewVersion).append(")");
+	 }
+      }
+      if (P.Conflicts == true)
+	 S.append("\nConflicts: ").append(P.Provides);
+      if (P.Provides.empty() == false)
+	 S.append("\nProvides: ").append(P.Provides);
+      S.append("\n\n");
+      return S;
+   }
+   std::string Universe()
+   {
+      std::string U;
+      ID = 0;
+      char const * const Archs[] = { "amd64", "i386" };
+      for (auto const &P : Pkgs)
+      {
+	 unsigned int const ArchCount = P.Type == Kind::Data ? 1 : 2;
+	 for (unsigned int a = 0; a < ArchCount; ++a)
+	 {
+	    char const * const Arch = P.Type == Kind::Data ? "all" : Archs[a];
+	    bool const InArchive = P.Obsolete == false && P.RenamedTo == 0;
+	    if (InArchive == true)
+	       U.append(Stanza(P, Arch, false, P.Installed[a] && P.Upgrade == false, P.Manual[a], true));
+	    if (P.Installed[a] == true && (P.Upgrade == true || InArchive == false))
+	       U.append(Stanza(P, Arch, true, true, P.Manual[a], InArchive == false));
+	 }
+      }
+      return U;
+   }
+   std::string RandomPackages(size_t const Count, unsigned int const Arch, bool const Installed)
+   {
+      char const * const Archs[] = { ":amd64", ":i386" };
+      std::string List;
+      for (size_t Tries = 0, Found = 0; Found < Count && Tries < 1000 * Count; ++Tries)
+      {
+	 /* programs are installed and for foreign architectures libraries,
+	    removing popular packages makes for interesting requests */
+	 auto const &P = Pkgs[Installed ? Popular(Pkgs.size()) : Below(Pkgs.size())];
+	 if (P.Installed[Arch] != Installed || P.Essential == true || P.Obsolete == true ||
+	       P.RenamedTo != 0 || P.Type == Kind::Data ||
+	       (Installed == false && P.Type != (Arch == 0 ? Kind::Program : Kind::Library)))
+	    continue;
+	 List.append(" ").append(P.Name).append(Archs[Arch]);
+	 ++Found;
+      }
+      return List;
+   }
+
+public:
+   ScenarioGenerator(unsigned long const Seed, size_t const Count) : Rand(Seed)
+   {
+      Generate(Count);
+   }
+
+   bool Write(std::string const &Dir)
+   {
+      if (DirectoryExists(Dir) == false && mkdir(Dir.c_str(), 0755) != 0)
+	 return _error->Errno("mkdir", "Unable to create directory %s", Dir.c_str());
+      std::string const Header = "Request: EDSP 0.5\nArchitecture: amd64\nArchitectures: amd64 i386\n";
+      std::vector<std::pair<std::string, std::string>> const Requests = {
+	 { "install", "Install:" + RandomPackages(10, 0, false) + "\n" },
+	 { "install-i386", "Install:" + RandomPackages(10, 1, false) + "\n" },
+	 { "remove", "Remove:" + RandomPackages(5, 0, true) + "\n" },
+	 { "upgrade", "Upgrade: yes\nUpgrade-All: yes\nForbid-New-Install: yes\nForbid-Remove: yes\n" },
+	 { "dist-upgrade", "Dist-Upgrade: yes\nUpgrade-All: yes\n" },
+      };
+      std::string const Scenario = Universe();
+      for (auto const &R : Requests)
+      {
+	 std::string const File = flCombine(Dir, R.first + ".edsp.gz");
+	 std::string const Request = Header + R.second + "Solver: benchmark\n\n";
+	 FileFd Out;
+	 if (Out.Open(File, FileFd::WriteOnly | FileFd::Create | FileFd::Empty, FileFd::Extension) == false ||
+	       Out.Write(Request.c_str(), Request.length()) == false ||
+	       Out.Write(Scenario.c_str(), Scenario.length()) == false ||
+	       Out.Close() == false)
+	    return _error->Error("Writing the scenario %s failed", File.c_str());
+      }
+      return true;
+   }
+};
+}
+									/*}}}*/
+// replaying scenarios							/*{{{*/
+struct Result
+{
+   double Seconds = 0;
+   long MaxRSS = 0;	// in KiB
+   unsigned long Install = 0;
+   unsigned long Remove = 0;
+   unsigned long Autoremove = 0;
+   std::string Error;
+};
+// Run the solver with the scenario on stdin, its answer goes to Answer
+static bool RunSolver(std::string const &Solver, FileFd &Scenario, FileFd &Answer, Result &R)
+{
+   if (lseek(Scenario.Fd(), 0, SEEK_SET) != 0 || Answer.Truncate(0) == false ||
+	 lseek(Answer.Fd(), 0, SEEK_SET) != 0)
+      return _error->Errno("lseek", "Unable to rewind the temporary files");
+
+   auto const Start = std::chrono::steady_clock::now();
+   pid_t const Child = ExecFork({ Scenario.Fd(), Answer.Fd() });
+   if (Child == 0)
+   {
+      dup2(Scenario.Fd(), STDIN_FILENO);
+      dup2(Answer.Fd(), STDOUT_FILENO);
+      execl(Solver.c_str(), Solver.c_str(), nullptr);
+      std::cerr << "Failed to execute solver '" << Solver << "'!" << std::endl;
+      _exit(100);
+   }
+   int Status;
+   struct rusage Usage;
+   if (wait4(Child, &Status, 0, &Usage) != Child)
+      return _error->Errno("wait4", "Waiting for solver %s failed", Solver.c_str());
+   R.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+   R.MaxRSS = Usage.ru_maxrss;
+   if (WIFEXITED(Status) == false || WEXITSTATUS(Status) != 0)
+   {
+      strprintf(R.Error, "exit status %d", WIFEXITED(Status) ? WEXITSTATUS(Status) : Status);
+      return true;
+   }
+
+   if (Answer.Seek(0) == false)
+      return false;
+   pkgTagFile Tags(&Answer);
+   pkgTagSection Section;
+   while (Tags.Step(Section) == true)
+   {
+      if (Section.Exists("Install") == true)
+	 ++R.Install;
+      else if (Section.Exists("Remove") == true)
+	 ++R.Remove;
+      else if (Section.Exists("Autoremove") == true)
+	 ++R.Autoremove;
+      else if (Section.Exists("Error") == true)
+	 R.Error = Section.FindS("Error");
+   }
+   return true;
+}
+static int ScenarioWidth = 0;
+static int SolverWidth = 0;
+static void Report(std::string const &Scenario, std::string const &Solver, Result const &R)
+{
+   printf("%-*s %-*s %9.3f s %9.1f MiB", ScenarioWidth, Scenario.c_str(),
+	 SolverWidth, Solver.c_str(), R.Seconds, R.MaxRSS / 1024.0);
+   if (R.Error.empty() == false)
+      printf("  %s\n", R.Error.c_str());
+   else
+      printf(" %8lu %8lu %8lu\n", R.Install, R.Remove, R.Autoremove);
+   fflush(stdout);
+}
+// Replay each scenario Runs times with each solver, report the fastest run
+static bool Replay(std::vector<std::string> const &Scenarios, std::vector<std::string> const &Solvers,
+      unsigned long const Runs)
+{
+   ScenarioWidth = strlen("scenario");
+   for (auto const &File : Scenarios)
+      ScenarioWidth = std::max<int>(ScenarioWidth, flNotDir(File).length());
+   SolverWidth = strlen("solver");
+   for (auto const &Solver : Solvers)
+      SolverWidth = std::max<int>(SolverWidth, Solver.length());
+   printf("%-*s %-*s %11s %13s %8s %8s %8s\n", ScenarioWidth, "scenario", SolverWidth, "solver",
+	 "time", "peak memory", "install", "remove", "autorm");
+   fflush(stdout);
+   for (auto const &File : Scenarios)
+   {
+      // solvers get the uncompressed scenario, like from apt
+      FileFd In;
+      std::unique_ptr<FileFd> Scenario(GetTempFile("solver-benchmark"));
+      std::unique_ptr<FileFd> Answer(GetTempFile("solver-benchmark"));
+      if (Scenario == nullptr || Answer == nullptr ||
+	    In.Open(File, FileFd::ReadOnly, FileFd::Extension) == false ||
+	    CopyFile(In, *Scenario) == false)
+	 return _error->Error("Preparing the scenario %s failed", File.c_str());
+
+      for (auto const &Solver : Solvers)
+      {
+	 Result Best;
+	 for (unsigned long r = 0; r < Runs; ++r)
+	 {
+	    Result R;
+	    if (RunSolver(Solver, *Scenario, *Answer, R) == false)
+	       return false;
+	    if (r == 0 || R.Seconds < Best.Seconds)
+	    {
+	       R.MaxRSS = std::max(R.MaxRSS, Best.MaxRSS);
+	       Best = R;
+	    }
+	    else
+	       Best.MaxRSS = std::max(R.MaxRSS, Best.MaxRSS);
+	 }
+	 Report(flNotDir(File), Solver, Best);
+      }
+   }
+   return true;
+}
+									/*}}}*/
+static int ShowUsage(char const * const Name)
+{
+   std::cerr << "Usage: " << Name << " [--solver PATH]... [--runs N] scenario|dir..." << std::endl
+      << "       " << Name << " generate [--seed N] [--packages N] dir" << std::endl;
+   return 100;
+}
+int main(int argc, char *argv[])
+{
+   if (pkgInitConfig(*_config) == false)
+   {
+      _error->DumpErrors();
+      return 100;
+   }
+
+   bool const Generate = argc > 1 && strcmp(argv[1], "generate") == 0;
+   unsigned long Seed = 42;
+   unsigned long Packages = 60000;
+   unsigned long Runs = 1;
+   std::vector<std::string> Solvers;
+   std::vector<std::string> Files;
+   for (int i = Generate ? 2 : 1; i < argc; ++i)
+   {
+      std::string const Arg = argv[i];
+      if (Generate == true && i + 1 < argc && Arg == "--seed")
+	 Seed = strtoul(argv[++i], nullptr, 10);
+      else if (Generate == true && i + 1 < argc && Arg == "--packages")
+	 Packages = strtoul(argv[++i], nullptr, 10);
+      else if (Generate == false && i + 1 < argc && Arg == "--solver")
+	 Solvers.push_back(argv[++i]);
+      else if (Generate == false && i + 1 < argc && Arg == "--runs")
+	 Runs = strtoul(argv[++i], nullptr, 10);
+      else if (Arg.empty() == false && Arg[0] != '-')
+	 Files.push_back(Arg);
+      else
+	 return ShowUsage(argv[0]);
+   }
+   if (Files.empty() == true || (Generate == true && Files.size() != 1))
+      return ShowUsage(argv[0]);
+   if (Packages < 100 || Runs == 0)
+   {
+      std::cerr << "--packages needs to be at least 100 and --runs positive" << std::endl;
+      return 100;
+   }
+
+   if (Generate == true)
+   {
+      ScenarioGenerator Generator(Seed, Packages);
+      Generator.Write(Files[0]);
+   }
+   else
+   {
+      if (Solvers.empty() == true)
+	 Solvers.push_back(_config->FindDir("Dir::Bin::Solvers") + "apt");
+      std::vector<std::string> Scenarios;
+      for (auto const &F : Files)
+      {
+	 if (DirectoryExists(F) == true)
+	 {
+	    auto const List = GetListOfFilesInDir(F, true);
+	    Scenarios.insert(Scenarios.end(), List.begin(), List.end());
+	 }
+	 else
+	    Scenarios.push_back(F);
+      }
+      if (_error->PendingError() == false)
+	 Replay(Scenarios, Solvers, Runs);
+   }
+
+   bool const Errors = _error->PendingError();
+   _error->DumpErrors();
+   return Errors ? 100 : 0;
+}
@@ -0,0 +1,98 @@
+#include <config.h>
+
+#include <apt-pkg/algorithms.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgcache.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "cache-helpers.h"
+
+/* libc has an upgrade breaking old-app, app can be upgraded to a version
+   needing it and a mail-transport-agent of which mta-a and mta-b are the
+   conflicting providers. base-files is essential, tool only recommended */
+static char const * const Scenario =
+   "Package: base-files\nArchitecture: amd64\nVersion: 1\nAPT-ID: 1\nInstalled: yes\nEssential: yes\nPriority: required\n\n"
+   "Package: libc\nArchitecture: amd64\nVersion: 1\nAPT-ID: 2\nInstalled: yes\nPriority: required\n\n"
+   "Package: libc\nArchitecture: amd64\nVersion: 2\nAPT-ID: 3\nPriority: required\nBreaks: old-app (<< 2)\n\n"
+   "Package: app\nArchitecture: amd64\nVersion: 1\nAPT-ID: 4\nInstalled: yes\nPriority: standard\nDepends: libc (>= 1)\nRecommends: tool\n\n"
+   "Package: app\nArchitecture: amd64\nVersion: 2\nAPT-ID: 5\nPriority: standard\nDepends: libc (>= 2), mail-transport-agent\nRecommends: tool\n\n"
+   "Package: old-app\nArchitecture: amd64\nVersion: 1\nAPT-ID: 6\nInstalled: yes\nPriority: extra\nDepends: libc (<< 2)\n\n"
+   "Package: mta-a\nArchitecture: amd64\nVersion: 1\nAPT-ID: 7\nInstalled: yes\nPriority: standard\nProvides: mail-transport-agent\nConflicts: mail-transport-agent\n\n"
+   "Package: mta-b\nArchitecture: amd64\nVersion: 1\nAPT-ID: 8\nPriority: optional\nProvides: mail-transport-agent\nConflicts: mail-transport-agent\n\n"
+   "Package: mailer\nArchitecture: amd64\nVersion: 1\nAPT-ID: 9\nInstalled: yes\nAPT-Automatic: yes\nPriority: optional\nDepends: mail-transport-agent\n\n"
+   "Package: tool\nArchitecture: amd64\nVersion: 1\nAPT-ID: 10\nPriority: optional\nDepends: libc\n\n";
+
+// the scores shown by the given resolver for the current state of the cache
+static std::string ShowScores(pkgProblemResolver &Fix, bool const ByKeep)
+{
+   std::ostringstream Out;
+   auto const OldBuf = std::clog.rdbuf(Out.rdbuf());
+   if (ByKeep == true)
+      Fix.ResolveByKeep();
+   else
+      Fix.Resolve(true);
+   std::clog.rdbuf(OldBuf);
+   return Out.str();
+}
+
+TEST(AlgorithmsTest, ReuseProblemResolver)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   pkgDepCache &Cache = *T.Cache;
+   _config->Set("Debug::pkgProblemResolver::ShowScores", true);
+
+   pkgProblemResolver Reused(&Cache);
+   std::vector<pkgCache::PkgIterator> Protected;
+   /* The reused resolver has to come up with the same scores as a new one
+      for the same state, both run from it with the help of a snapshot */
+   auto const Compare = [&](bool const ByKeep) {
+      pkgDepCache::ActionGroup group(Cache);
+      unsigned long const Id = Cache.Snapshot();
+      pkgProblemResolver Fresh(&Cache);
+      for (auto const &P : Protected)
+	 Fresh.Protect(P);
+      std::string const Expected = ShowScores(Fresh, ByKeep);
+      EXPECT_NE(std::string::npos, Expected.find("Show Scores"));
+      EXPECT_TRUE(Cache.Rollback(Id));
+      for (auto const &P : Protected)
+	 Reused.Protect(P);
+      EXPECT_EQ(Expected, ShowScores(Reused, ByKeep));
+      Cache.ForgetSnapshot(Id);
+   };
+
+   // the first run calculates everything
+   Cache.MarkInstall(T.Pkg("app"), false);
+   EXPECT_NE(0u, Cache.BrokenCount());
+   Compare(false);
+
+   // a new install version of a provider and a protected package
+   Cache.MarkDelete(T.Pkg("mta-a"));
+   Cache.MarkInstall(T.Pkg("mta-b"), false);
+   Protected.push_back(T.Pkg("mta-b"));
+   Compare(true);
+
+   // versioned dependencies on libc are satisfied differently
+   Cache.MarkInstall(T.Pkg("libc"), false);
+   Cache.MarkInstall(T.Pkg("tool"), false);
+   Compare(false);
+
+   // back to the installed versions, changing a candidate on the way
+   Cache.MarkKeep(T.Pkg("libc"));
+   Cache.MarkKeep(T.Pkg("app"));
+   Cache.MarkKeep(T.Pkg("mta-a"));
+   Cache.MarkDelete(T.Pkg("old-app"));
+   Cache.SetCandidateVersion(T.Ver("app", "1"));
+   Compare(true);
+   Compare(false);
+
+   _error->Discard();
+}
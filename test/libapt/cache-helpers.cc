@@ -0,0 +1,52 @@
+#include <config.h>
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include <string>
+
+#include <string.h>
+#include <unistd.h>
+
+#include "cache-helpers.h"
+#include "file-helpers.h"
+
+ScenarioCache::ScenarioCache(char const * const Scenario) : OldSystem(_system), Cache(nullptr)
+{
+   FileFd fd;
+   helperCreateTemporaryFile("scenario", fd, &ScenarioFile, Scenario);
+   _config->Clear();
+   _config->Set("APT::Architecture", "amd64");
+   _config->Set("APT::Architectures::", "amd64");
+   _config->Set("APT::System", "Debian APT solver interface");
+   _config->Set("Dir::Etc::sourcelist", "/dev/null");
+   _config->Set("Dir::Etc::sourceparts", "/dev/null");
+   _config->Set("edsp::scenario", ScenarioFile);
+   if (pkgInitSystem(*_config, _system) == true && CacheFile.Open(nullptr, false) == true)
+      Cache = CacheFile.GetDepCache();
+}
+ScenarioCache::~ScenarioCache()
+{
+   CacheFile.Close();
+   if (ScenarioFile.empty() == false)
+      unlink(ScenarioFile.c_str());
+   _system = OldSystem;
+   _config->Clear();
+}
+pkgCache::PkgIterator ScenarioCache::Pkg(char const * const Name)
+{
+   return Cache->FindPkg(Name, "amd64");
+}
+pkgCache::VerIterator ScenarioCache::Ver(char const * const Name, char const * const Version)
+{
+   auto const P = Pkg(Name);
+   for (auto V = P.VersionList(); V.end() == false; ++V)
+      if (strcmp(V.VerStr(), Version) == 0)
+	 return V;
+   return pkgCache::VerIterator(*Cache);
+}
@@ -0,0 +1,29 @@
+#ifndef APT_TESTS_CACHE_HELPERS
+#define APT_TESTS_CACHE_HELPERS
+
+#include <apt-pkg/cachefile.h>
+#include <apt-pkg/pkgcache.h>
+
+#include <string>
+
+class pkgDepCache;
+class pkgSystem;
+
+/* A cache built from an EDSP scenario for tests working with the state of
+   the packages. The configuration is cleared before and afterwards. */
+class ScenarioCache
+{
+   pkgSystem * const OldSystem;
+   std::string ScenarioFile;
+   public:
+   pkgCacheFile CacheFile;
+   pkgDepCache *Cache;
+
+   pkgCache::PkgIterator Pkg(char const * const Name);
+   pkgCache::VerIterator Ver(char const * const Name, char const * const Version);
+
+   explicit ScenarioCache(char const * const Scenario);
+   ~ScenarioCache();
+};
+
+#endif
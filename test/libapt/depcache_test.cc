@@ -0,0 +1,153 @@
+#include <config.h>
+
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/strutl.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "cache-helpers.h"
+
+/* a is installed and has an upgrade which needs the upgrade of b, c needs
+   d and e is garbage from the start */
+static char const * const Scenario =
+   "Package: a\nArchitecture: amd64\nVersion: 1\nAPT-ID: 1\nInstalled: yes\nDepends: b\n\n"
+   "Package: a\nArchitecture: amd64\nVersion: 2\nAPT-ID: 2\nDepends: b (>= 2)\n\n"
+   "Package: b\nArchitecture: amd64\nVersion: 1\nAPT-ID: 3\nInstalled: yes\nAPT-Automatic: yes\n\n"
+   "Package: b\nArchitecture: amd64\nVersion: 2\nAPT-ID: 4\n\n"
+   "Package: c\nArchitecture: amd64\nVersion: 1\nAPT-ID: 5\nDepends: d\n\n"
+   "Package: d\nArchitecture: amd64\nVersion: 1\nAPT-ID: 6\n\n"
+   "Package: e\nArchitecture: amd64\nVersion: 1\nAPT-ID: 7\nInstalled: yes\nAPT-Automatic: yes\n\n";
+
+// everything a rollback has to restore
+static std::string State(pkgDepCache &Cache)
+{
+   std::string Out;
+   strprintf(Out, "inst %lu del %lu keep %lu broken %lu policy %lu bad %lu usr %lld deb %llu\n",
+	 Cache.InstCount(), Cache.DelCount(), Cache.KeepCount(), Cache.BrokenCount(),
+	 Cache.PolicyBrokenCount(), Cache.BadCount(), Cache.UsrSize(), Cache.DebSize());
+   for (auto P = Cache.PkgBegin(); P.end() == false; ++P)
+   {
+      auto &S = Cache[P];
+      auto const Inst = S.InstVerIter(Cache);
+      auto const Cand = S.CandidateVerIter(Cache);
+      strprintf(Out, "%s%s: mode %d status %d flags %d/%d dep %d marked %d garbage %d inst %s cand %s\n",
+	    Out.c_str(), P.Name(), S.Mode, S.Status, S.Flags, S.iFlags, S.DepState,
+	    S.Marked, S.Garbage, Inst.end() ? "-" : Inst.VerStr(),
+	    Cand.end() ? "-" : Cand.VerStr());
+      for (auto V = P.VersionList(); V.end() == false; ++V)
+	 for (auto D = V.DependsList(); D.end() == false; ++D)
+	    strprintf(Out, "%s  %s %s -> %s: %d\n", Out.c_str(), P.Name(), V.VerStr(),
+		  D.TargetPkg().Name(), Cache[D]);
+   }
+   return Out;
+}
+
+TEST(DepCacheTest, RollbackStateManipulators)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   pkgDepCache &Cache = *T.Cache;
+   EXPECT_TRUE(Cache[T.Pkg("e")].Garbage);
+   std::string const Initial = State(Cache);
+
+   pkgDepCache::ActionGroup group(Cache);
+   unsigned long const Id = Cache.Snapshot();
+
+   Cache.MarkInstall(T.Pkg("a"), true);
+   EXPECT_EQ(2u, Cache.InstCount());
+   EXPECT_TRUE(Cache[T.Pkg("b")].Upgrade());
+   EXPECT_TRUE(Cache.Rollback(Id));
+   EXPECT_EQ(Initial, State(Cache));
+
+   Cache.MarkDelete(T.Pkg("b"));
+   EXPECT_EQ(1u, Cache.DelCount());
+   EXPECT_NE(0u, Cache.BrokenCount());
+   EXPECT_TRUE(Cache.Rollback(Id));
+   EXPECT_EQ(Initial, State(Cache));
+
+   Cache.SetCandidateVersion(T.Ver("a", "1"));
+   EXPECT_STREQ("1", Cache.GetCandidateVersion(T.Pkg("a")).VerStr());
+   Cache.MarkInstall(T.Pkg("c"), true);
+   EXPECT_EQ(2u, Cache.InstCount());
+   EXPECT_TRUE(Cache.Rollback(Id));
+   EXPECT_EQ(Initial, State(Cache));
+   EXPECT_STREQ("2", Cache.GetCandidateVersion(T.Pkg("a")).VerStr());
+
+   // the changes are kept once the snapshot is forgotten
+   Cache.MarkInstall(T.Pkg("c"), true);
+   std::string const Installed = State(Cache);
+   Cache.ForgetSnapshot(Id);
+   EXPECT_EQ(Installed, State(Cache));
+}
+
+TEST(DepCacheTest, RollbackNestedSnapshots)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   pkgDepCache &Cache = *T.Cache;
+   pkgDepCache::ActionGroup group(Cache);
+   std::string const Initial = State(Cache);
+
+   unsigned long const Outer = Cache.Snapshot();
+   Cache.MarkInstall(T.Pkg("c"), true);
+   std::string const WithC = State(Cache);
+
+   unsigned long const Inner = Cache.Snapshot();
+   EXPECT_NE(Outer, Inner);
+   Cache.MarkInstall(T.Pkg("a"), true);
+   Cache.MarkDelete(T.Pkg("e"));
+   EXPECT_EQ(4u, Cache.InstCount());
+   EXPECT_EQ(1u, Cache.DelCount());
+
+   EXPECT_TRUE(Cache.Rollback(Inner));
+   EXPECT_EQ(WithC, State(Cache));
+   // the inner snapshot stays, so it can be rolled back to again
+   Cache.MarkDelete(T.Pkg("a"));
+   EXPECT_TRUE(Cache.Rollback(Inner));
+   EXPECT_EQ(WithC, State(Cache));
+
+   EXPECT_TRUE(Cache.Rollback(Outer));
+   EXPECT_EQ(Initial, State(Cache));
+
+   // rolling back the outer one forgot the inner one for good
+   unsigned long const Newer = Cache.Snapshot();
+   EXPECT_NE(Inner, Newer);
+   EXPECT_FALSE(Cache.Rollback(Inner));
+   EXPECT_TRUE(_error->PendingError());
+   _error->Discard();
+   Cache.ForgetSnapshot(Newer);
+   EXPECT_FALSE(Cache.Rollback(Newer));
+   _error->Discard();
+   EXPECT_TRUE(Cache.Rollback(Outer));
+   Cache.ForgetSnapshot(Outer);
+   EXPECT_FALSE(Cache.Rollback(Outer));
+   _error->Discard();
+   EXPECT_EQ(Initial, State(Cache));
+}
+
+TEST(DepCacheTest, RollbackSweep)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   pkgDepCache &Cache = *T.Cache;
+   std::string const Initial = State(Cache);
+   EXPECT_FALSE(Cache[T.Pkg("b")].Garbage);
+
+   // without an action group the removal calculation runs after each change
+   unsigned long const Id = Cache.Snapshot();
+   Cache.MarkDelete(T.Pkg("a"));
+   EXPECT_TRUE(Cache[T.Pkg("b")].Garbage);
+   EXPECT_TRUE(Cache.Rollback(Id));
+   EXPECT_FALSE(Cache[T.Pkg("b")].Garbage);
+   EXPECT_EQ(Initial, State(Cache));
+
+   Cache.MarkDelete(T.Pkg("a"));
+   EXPECT_TRUE(Cache[T.Pkg("b")].Garbage);
+   EXPECT_TRUE(Cache.Rollback(Id));
+   EXPECT_EQ(Initial, State(Cache));
+   Cache.ForgetSnapshot(Id);
+}
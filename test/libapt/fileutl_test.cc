@@ -389,3 +389,65 @@ TEST(FileUtlTest, FailingAtomic)
    if (filename.empty() == false)
       unlink(filename.c_str());
 }
+static void TestCopyFile(char const * const label, FileFd &From, unsigned int const ToMode,
+      char const * const Prefix, std::string const &Expected)
+{
+   SCOPED_TRACE(label);
+   FileFd To;
+   std::string toname;
+   createTemporaryFile("copyfile-to", To, &toname, nullptr);
+   ASSERT_TRUE(To.Open(toname, ToMode));
+   if (Prefix != nullptr)
+   {
+      EXPECT_TRUE(To.Write(Prefix, strlen(Prefix)));
+   }
+   EXPECT_TRUE(CopyFile(From, To));
+   EXPECT_EQ(Expected.size(), To.Tell());
+   EXPECT_TRUE(To.Close());
+
+   std::string content(Expected.size() + 100, '\0');
+   unsigned long long actual = 0;
+   EXPECT_TRUE(To.Open(toname, FileFd::ReadOnly));
+   EXPECT_TRUE(To.Read(&content[0], content.size(), &actual));
+   content.resize(actual);
+   EXPECT_EQ(Expected, content);
+   unlink(toname.c_str());
+}
+TEST(FileUtlTest, CopyFile)
+{
+   std::string data;
+   for (size_t i = 0; data.size() < 300 * 1024; ++i)
+      data.append(std::to_string(i)).append("\n");
+
+   FileFd From;
+   std::string fromname;
+   createTemporaryFile("copyfile-from", From, &fromname, data.c_str());
+   ASSERT_TRUE(From.Open(fromname, FileFd::ReadOnly));
+   TestCopyFile("complete", From, FileFd::WriteOnly | FileFd::Empty, nullptr, data);
+   EXPECT_TRUE(From.Seek(0));
+   TestCopyFile("buffered", From, FileFd::WriteOnly | FileFd::Empty | FileFd::BufferedWrite, "prefix", "prefix" + data);
+   EXPECT_TRUE(From.Seek(0));
+   TestCopyFile("atomic", From, FileFd::WriteAtomic, nullptr, data);
+
+   // a partly read file is copied from where the reading stopped
+   char buffer[50];
+   EXPECT_TRUE(From.Seek(0));
+   EXPECT_NE(nullptr, From.ReadLine(buffer, sizeof(buffer)));
+   EXPECT_STREQ("0\n", buffer);
+   TestCopyFile("readline", From, FileFd::WriteOnly | FileFd::Empty, nullptr, data.substr(2));
+   EXPECT_TRUE(From.Seek(1000));
+   TestCopyFile("seeked", From, FileFd::WriteOnly | FileFd::Empty, nullptr, data.substr(1000));
+   EXPECT_TRUE(From.Close());
+
+   FileFd Gz;
+   std::string gzname = fromname + ".gz";
+   ASSERT_TRUE(Gz.Open(gzname, FileFd::WriteOnly | FileFd::Create | FileFd::Empty, FileFd::Gzip));
+   EXPECT_TRUE(Gz.Write(data.c_str(), data.size()));
+   EXPECT_TRUE(Gz.Close());
+   ASSERT_TRUE(Gz.Open(gzname, FileFd::ReadOnly, FileFd::Gzip));
+   TestCopyFile("gzip", Gz, FileFd::WriteOnly | FileFd::Empty, nullptr, data);
+   EXPECT_TRUE(Gz.Close());
+
+   unlink(gzname.c_str());
+   unlink(fromname.c_str());
+}
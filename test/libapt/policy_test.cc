@@ -0,0 +1,81 @@
+#include <config.h>
+
+#include <apt-pkg/depcache.h>
+#include <apt-pkg/error.h>
+#include <apt-pkg/pkgcache.h>
+#include <apt-pkg/policy.h>
+#include <apt-pkg/versionmatch.h>
+
+#include <gtest/gtest.h>
+
+#include "cache-helpers.h"
+
+// foo is installed and has an upgrade, bar isn't installed at all
+static char const * const Scenario =
+   "Package: foo\nArchitecture: amd64\nVersion: 1\nAPT-ID: 1\nInstalled: yes\n\n"
+   "Package: foo\nArchitecture: amd64\nVersion: 2\nAPT-ID: 2\n\n"
+   "Package: foo\nArchitecture: amd64\nVersion: 3\nAPT-ID: 3\n\n"
+   "Package: bar\nArchitecture: amd64\nVersion: 1\nAPT-ID: 4\n\n";
+
+static std::string Candidate(pkgPolicy &Plcy, pkgCache::PkgIterator const &Pkg)
+{
+   auto const Cand = Plcy.GetCandidateVer(Pkg);
+   return Cand.end() ? "-" : Cand.VerStr();
+}
+
+TEST(PolicyTest, CandidateAfterCreatePin)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   pkgPolicy Plcy(&T.Cache->GetCache());
+   auto const foo = T.Pkg("foo");
+   auto const bar = T.Pkg("bar");
+
+   EXPECT_EQ("3", Candidate(Plcy, foo));
+   EXPECT_EQ("1", Candidate(Plcy, bar));
+
+   // a new pin for a package changes only its candidate
+   Plcy.CreatePin(pkgVersionMatch::Version, "foo", "2", 990);
+   EXPECT_EQ("2", Candidate(Plcy, foo));
+   EXPECT_EQ("1", Candidate(Plcy, bar));
+
+   // the first pin for a version wins
+   Plcy.CreatePin(pkgVersionMatch::Version, "foo", "2", -1);
+   EXPECT_EQ("2", Candidate(Plcy, foo));
+   Plcy.CreatePin(pkgVersionMatch::Version, "foo", "3", 995);
+   EXPECT_EQ("3", Candidate(Plcy, foo));
+
+   // pins by wildcard change the candidates of all matching packages
+   Plcy.CreatePin(pkgVersionMatch::Version, "b*", "1", -1);
+   EXPECT_EQ("3", Candidate(Plcy, foo));
+   EXPECT_EQ("-", Candidate(Plcy, bar));
+
+   _error->Discard();
+}
+
+/* derived classes have access to the pins, so they don't get candidates
+   which were calculated before the pins were changed */
+class ChangingPolicy : public pkgPolicy
+{
+   public:
+   void Forbid(pkgCache::VerIterator const &Ver)
+   {
+      VerPins[Ver->ID].Type = pkgVersionMatch::Version;
+      VerPins[Ver->ID].Data = Ver.VerStr();
+      VerPins[Ver->ID].Priority = -1;
+   }
+   explicit ChangingPolicy(pkgCache * const Owner) : pkgPolicy(Owner) {}
+};
+TEST(PolicyTest, CandidateOfDerivedPolicy)
+{
+   ScenarioCache T(Scenario);
+   ASSERT_NE(nullptr, T.Cache);
+   ChangingPolicy Plcy(&T.Cache->GetCache());
+   auto const foo = T.Pkg("foo");
+
+   EXPECT_EQ("3", Candidate(Plcy, foo));
+   Plcy.Forbid(T.Ver("foo", "3"));
+   EXPECT_EQ("2", Candidate(Plcy, foo));
+
+   _error->Discard();
+}